@@ -0,0 +1,262 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#ifndef XYREGENGINE_AHO_CORASICK_H
+#define XYREGENGINE_AHO_CORASICK_H
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "char_class.h"
+#include "lex.h"
+
+namespace XyRegEngine {
+/**
+ * Aho-Corasick automaton for a set of literal strings. It is a trie of the
+ * literals with a failure link from every state to the state of its
+ * longest proper suffix in the trie.
+ *
+ * Transitions use a dense/sparse hybrid layout. States less than
+ * kDenseDepth characters deep are dense: they hold the next state of every
+ * character class with failure links resolved, so the root never needs a
+ * failure link. Deeper states are far more numerous and have few edges, so
+ * they only keep their trie edges sorted by character classes and fall
+ * back to their failure links.
+ */
+template<class T>
+class AhoCorasick {
+ public:
+  static constexpr int kDenseDepth = 2;
+
+  AhoCorasick() = default;
+
+  /**
+   * @param literals They should not contain the empty string.
+   */
+  explicit AhoCorasick(const std::set<std::basic_string<T>> &literals);
+
+  [[nodiscard]] bool Empty() const {
+    return states_.empty();
+  }
+
+  [[nodiscard]] int GetStateNum() const {
+    return states_.size();
+  }
+
+  /**
+   * Find the longest literal which begins at begin.
+   *
+   * @param begin
+   * @param end
+   * @param match_end end of the literal. It is only set when it exists.
+   * @return whether a literal begins at begin
+   */
+  bool NextMatch(StrConstIt<T> begin, StrConstIt<T> end,
+                 StrConstIt<T> &match_end) const;
+
+  /**
+   * Find the leftmost literal in the range of [begin, end). If several
+   * literals begin at the same location, the longest one is chosen.
+   *
+   * The automaton reports the longest literal ending at every location,
+   * which is the earliest one. After a literal is found, it goes on until
+   * the trie path of the current state begins later than the literal, since
+   * only such a path can lead to an earlier or longer literal.
+   *
+   * @param begin
+   * @param end
+   * @param match It is only set when a literal is found.
+   * @return whether a literal is found
+   */
+  bool Search(StrConstIt<T> begin, StrConstIt<T> end,
+              std::pair<StrConstIt<T>, StrConstIt<T>> &match) const;
+
+ private:
+  static constexpr int kRoot = 0;
+  static constexpr int kNoState = -1;
+
+  struct State {
+    int depth{0};
+    int fail{kRoot};
+    // length of the longest literal ending at the state, including those
+    // reached through failure links, or 0 if there is none
+    int output{0};
+    // whether a literal ends exactly at the state
+    bool is_literal{false};
+    // beginning of the row in dense_transitions_, or kNoState for a sparse
+    // state
+    int dense{kNoState};
+    // trie edges sorted by character classes
+    std::vector<std::pair<int, int>> edges;
+  };
+
+  /**
+   * @return the child of state in the trie, or kNoState
+   */
+  [[nodiscard]] int Child(int state, int char_class) const;
+
+  /**
+   * @return the next state of state after a character of char_class
+   */
+  [[nodiscard]] int Next(int state, int char_class) const {
+    while (states_[state].dense == kNoState) {
+      int child = Child(state, char_class);
+      if (child != kNoState) {
+        return child;
+      }
+      state = states_[state].fail;
+    }
+    return dense_transitions_[states_[state].dense + char_class];
+  }
+
+  // Every character in literals has its own class and all other characters
+  // are in class 0, which has no edges.
+  CharClassMap<T> char_classes_;
+  int class_num_{1};
+
+  std::vector<State> states_;
+  // dense_transitions_[state.dense + char_class] -- next state
+  std::vector<int> dense_transitions_;
+};
+
+template<class T>
+AhoCorasick<T>::AhoCorasick(const std::set<std::basic_string<T>> &literals) {
+  using namespace std;
+
+  set<unsigned int> characters;
+  for (const auto &literal:literals) {
+    for (auto c:literal) {
+      characters.insert(CodePoint(c));
+    }
+  }
+  vector<unsigned int> boundaries{0};
+  vector<int> classes{0};
+  for (auto c:characters) {
+    if (c != boundaries.back()) {
+      boundaries.push_back(c);
+      classes.push_back(0);
+    }
+    classes.back() = class_num_++;
+    boundaries.push_back(c + 1);
+    classes.push_back(0);
+  }
+  char_classes_ = CharClassMap<T>(boundaries, classes);
+
+  // build the trie
+  states_.emplace_back();
+  for (const auto &literal:literals) {
+    int state = kRoot;
+    for (auto c:literal) {
+      int char_class = char_classes_(c);
+      int child = Child(state, char_class);
+      if (child == kNoState) {
+        child = states_.size();
+        auto &edges = states_[state].edges;
+        edges.insert(lower_bound(edges.begin(), edges.end(),
+                                 make_pair(char_class, 0)),
+                     {char_class, child});
+        states_.emplace_back();
+        states_[child].depth = states_[state].depth + 1;
+      }
+      state = child;
+    }
+    states_[state].is_literal = true;
+    states_[state].output = states_[state].depth;
+  }
+
+  // Set failure links in breadth-first order, so states closer to the root
+  // are finished first.
+  vector<int> queue{kRoot};
+  for (std::size_t i = 0; i < queue.size(); ++i) {
+    int state = queue[i];
+    for (auto [char_class, child]:states_[state].edges) {
+      if (state != kRoot) {
+        states_[child].fail = Next(states_[state].fail, char_class);
+      }
+      if (!states_[child].is_literal) {
+        states_[child].output = states_[states_[child].fail].output;
+      }
+      queue.push_back(child);
+    }
+
+    if (states_[state].depth < kDenseDepth) {
+      vector<int> row(class_num_);
+      for (int char_class = 0; char_class < class_num_; ++char_class) {
+        int child = Child(state, char_class);
+        if (child != kNoState) {
+          row[char_class] = child;
+        } else {
+          row[char_class] = state == kRoot
+                            ? kRoot : Next(states_[state].fail, char_class);
+        }
+      }
+      states_[state].dense = dense_transitions_.size();
+      dense_transitions_.insert(dense_transitions_.end(), row.cbegin(),
+                                row.cend());
+    }
+  }
+}
+
+template<class T>
+int AhoCorasick<T>::Child(int state, int char_class) const {
+  using namespace std;
+
+  const auto &edges = states_[state].edges;
+  auto it = lower_bound(edges.cbegin(), edges.cend(),
+                        make_pair(char_class, 0));
+  return it != edges.cend() && it->first == char_class ? it->second
+                                                       : kNoState;
+}
+
+template<class T>
+bool AhoCorasick<T>::NextMatch(StrConstIt<T> begin, StrConstIt<T> end,
+                               StrConstIt<T> &match_end) const {
+  if (Empty()) {
+    return false;
+  }
+
+  bool is_matched = false;
+  int state = kRoot;
+  for (auto cur = begin; cur != end; ++cur) {
+    state = Child(state, char_classes_(*cur));
+    if (state == kNoState) {
+      break;
+    }
+    if (states_[state].is_literal) {
+      is_matched = true;
+      match_end = cur + 1;
+    }
+  }
+  return is_matched;
+}
+
+template<class T>
+bool AhoCorasick<T>::Search(
+        StrConstIt<T> begin, StrConstIt<T> end,
+        std::pair<StrConstIt<T>, StrConstIt<T>> &match) const {
+  if (Empty()) {
+    return false;
+  }
+
+  bool is_matched = false;
+  int state = kRoot;
+  for (auto cur = begin; cur != end;) {
+    state = Next(state, char_classes_(*cur++));
+    if (is_matched && cur - states_[state].depth > match.first) {
+      break;
+    }
+    int output = states_[state].output;
+    if (output != 0 && (!is_matched || cur - output <= match.first)) {
+      is_matched = true;
+      match = {cur - output, cur};
+    }
+  }
+  return is_matched;
+}
+}
+
+#endif //XYREGENGINE_AHO_CORASICK_H
@@ -0,0 +1,228 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#ifndef XYREGENGINE_CHAR_CLASS_H
+#define XYREGENGINE_CHAR_CLASS_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace XyRegEngine {
+/**
+ * Get the code point of c. char is treated as unsigned, so every byte
+ * value is in [0, 256).
+ *
+ * @param c
+ * @return
+ */
+template<class T>
+unsigned int CodePoint(T c) {
+  if constexpr (sizeof(T) == 1) {
+    return static_cast<unsigned char>(c);
+  } else {
+    return static_cast<unsigned int>(c);
+  }
+}
+
+/**
+ * It maps a character to the character class it belongs to. The alphabet
+ * is split to continuous intervals and every interval is mapped to a
+ * class. Several intervals can share a class. Code points less than
+ * kTableSize are resolved by a table, so for char it is always a single
+ * load. Larger code points are resolved by a binary search on the interval
+ * boundaries.
+ */
+template<class T>
+class CharClassMap {
+ public:
+  static constexpr unsigned int kTableSize = 256;
+
+  CharClassMap() = default;
+
+  /**
+   * @param boundaries Beginnings of the intervals in ascending order.
+   * Interval i is [boundaries[i], boundaries[i + 1]) and the last interval
+   * ends at the end of the alphabet. boundaries[0] should be 0.
+   * @param classes class of every interval
+   */
+  CharClassMap(std::vector<unsigned int> boundaries, std::vector<int> classes);
+
+  [[nodiscard]] int operator()(T c) const {
+    auto code_point = CodePoint(c);
+    if (code_point < kTableSize) {
+      return table_[code_point];
+    }
+    return SearchClass(code_point);
+  }
+
+  [[nodiscard]] const std::vector<unsigned int> &GetBoundaries() const {
+    return boundaries_;
+  }
+
+ private:
+  [[nodiscard]] int SearchClass(unsigned int code_point) const;
+
+  std::array<int, kTableSize> table_{};
+  std::vector<unsigned int> boundaries_;
+  std::vector<int> classes_;
+};
+
+template<class T>
+CharClassMap<T>::CharClassMap(std::vector<unsigned int> boundaries,
+                              std::vector<int> classes)
+        : boundaries_(std::move(boundaries)), classes_(std::move(classes)) {
+  for (unsigned int c = 0; c < kTableSize; ++c) {
+    table_[c] = SearchClass(c);
+  }
+}
+
+/**
+ * A set of characters compiled from a character class, e.g. \\d or [^a-z].
+ * It is kept as sorted disjoint intervals of code points. Code points less
+ * than kBitmapSize are also kept in a bitmap, so testing a byte is a single
+ * bit test and a larger code point is found by a binary search.
+ */
+template<class T>
+class CharSet {
+ public:
+  using Interval = std::pair<unsigned int, unsigned int>;
+
+  static constexpr unsigned int kBitmapSize = 256;
+
+  // the largest code point of T
+  static constexpr unsigned int kMaxCodePoint =
+          std::numeric_limits<std::make_unsigned_t<T>>::max();
+
+  CharSet() = default;
+
+  /**
+   * Add code points in [first, last]. Nothing is added if first > last.
+   *
+   * @param first
+   * @param last
+   */
+  void Add(unsigned int first, unsigned int last);
+
+  void Add(const CharSet &char_set);
+
+  /**
+   * Replace the set with its complement in [0, kMaxCodePoint].
+   */
+  void Invert();
+
+  [[nodiscard]] bool Contains(T c) const {
+    auto code_point = CodePoint(c);
+    if (code_point < kBitmapSize) {
+      return bitmap_[code_point / 64] >> (code_point % 64) & 1;
+    }
+    return SearchInterval(code_point);
+  }
+
+  /**
+   * @return sorted disjoint intervals [first, last] of the set
+   */
+  [[nodiscard]] const std::vector<Interval> &GetIntervals() const {
+    return intervals_;
+  }
+
+ private:
+  /**
+   * Sort and merge intervals_ and rebuild bitmap_ from them.
+   */
+  void Update();
+
+  [[nodiscard]] bool SearchInterval(unsigned int code_point) const;
+
+  std::array<uint64_t, kBitmapSize / 64> bitmap_{};
+  std::vector<Interval> intervals_;
+};
+
+template<class T>
+void CharSet<T>::Add(unsigned int first, unsigned int last) {
+  if (first > last) {
+    return;
+  }
+  intervals_.emplace_back(first, std::min(last, kMaxCodePoint));
+  Update();
+}
+
+template<class T>
+void CharSet<T>::Add(const CharSet &char_set) {
+  intervals_.insert(intervals_.end(), char_set.intervals_.cbegin(),
+                    char_set.intervals_.cend());
+  Update();
+}
+
+template<class T>
+void CharSet<T>::Invert() {
+  using namespace std;
+
+  vector<Interval> complement;
+  // the first code point not covered yet
+  unsigned long long next = 0;
+  for (const auto &[first, last]:intervals_) {
+    if (first > next) {
+      complement.emplace_back(next, first - 1);
+    }
+    next = static_cast<unsigned long long>(last) + 1;
+  }
+  if (next <= kMaxCodePoint) {
+    complement.emplace_back(next, kMaxCodePoint);
+  }
+  intervals_ = std::move(complement);
+  Update();
+}
+
+template<class T>
+void CharSet<T>::Update() {
+  using namespace std;
+
+  sort(intervals_.begin(), intervals_.end());
+  vector<Interval> merged;
+  for (const auto &interval:intervals_) {
+    if (!merged.empty() && (merged.back().second == kMaxCodePoint ||
+                            interval.first <= merged.back().second + 1)) {
+      merged.back().second = max(merged.back().second, interval.second);
+    } else {
+      merged.push_back(interval);
+    }
+  }
+  intervals_ = std::move(merged);
+
+  bitmap_.fill(0);
+  for (const auto &[first, last]:intervals_) {
+    for (auto c = first; c <= last && c < kBitmapSize; ++c) {
+      bitmap_[c / 64] |= uint64_t(1) << (c % 64);
+    }
+  }
+}
+
+template<class T>
+bool CharSet<T>::SearchInterval(unsigned int code_point) const {
+  using namespace std;
+
+  // the first interval beginning after code_point
+  auto it = upper_bound(intervals_.cbegin(), intervals_.cend(),
+                        Interval(code_point, numeric_limits<unsigned>::max()));
+  return it != intervals_.cbegin() && prev(it)->second >= code_point;
+}
+
+template<class T>
+int CharClassMap<T>::SearchClass(unsigned int code_point) const {
+  using namespace std;
+
+  auto it = upper_bound(boundaries_.cbegin(), boundaries_.cend(), code_point);
+  if (it == boundaries_.cbegin()) {
+    return -1;
+  }
+  return classes_[it - boundaries_.cbegin() - 1];
+}
+}
+
+#endif //XYREGENGINE_CHAR_CLASS_H
@@ -0,0 +1,1034 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#ifndef XYREGENGINE_DFA_H
+#define XYREGENGINE_DFA_H
+
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "char_class.h"
+#include "nfa.h"
+
+namespace XyRegEngine {
+/**
+ * A copy of a NFA that can be determinized. States are renumbered from 0
+ * and edges are labelled with character classes instead of character
+ * ranges. Every special pattern and range consumes exactly one character,
+ * so they are turned into character edges leading to the states behind
+ * them. As a result, the NFA only contains empty edges and character edges.
+ *
+ * Character classes are chosen so that every character in a class has the
+ * same edges in the whole NFA.
+ */
+template<class T>
+class ClassNfa {
+ public:
+  static constexpr int kNoTag = -1;
+
+  /**
+   * A NFA can be converted only if it is not empty and it contains no
+   * assertions, groups, counted repetitions and back-references, since they
+   * depend on more than one character.
+   *
+   * @param nfa
+   * @return
+   */
+  static bool IsSupported(const Nfa<T> &nfa);
+
+  /**
+   * @param nfa IsSupported(nfa) must be true
+   * @param tagged_states States of nfa that should still be recognized
+   * after the conversion, e.g. accept states of regexes in a set. The tag
+   * of such a state is its index in tagged_states. Negative ones are
+   * ignored.
+   */
+  explicit ClassNfa(const Nfa<T> &nfa,
+                    const std::vector<int> &tagged_states = {});
+
+  [[nodiscard]] int GetCharClass(T c) const {
+    return char_classes_(c);
+  }
+
+  [[nodiscard]] int GetClassNum() const {
+    return class_num_;
+  }
+
+  [[nodiscard]] const CharClassMap<T> &GetCharClassMap() const {
+    return char_classes_;
+  }
+
+  [[nodiscard]] int GetBeginState() const {
+    return begin_state_;
+  }
+
+  [[nodiscard]] int GetAcceptState() const {
+    return accept_state_;
+  }
+
+  /**
+   * @param state
+   * @return index of state in tagged_states, or kNoTag
+   */
+  [[nodiscard]] int GetTag(int state) const {
+    return tags_[state];
+  }
+
+  /**
+   * Add all states that can be reached through empty edges to 'states'.
+   *
+   * @param states
+   * @return sorted states without duplicates
+   */
+  [[nodiscard]] std::vector<int> Closure(const std::vector<int> &states) const;
+
+  /**
+   * @param states
+   * @param char_class
+   * @return closure of all states reached from 'states' through an edge of
+   * 'char_class'
+   */
+  [[nodiscard]] std::vector<int>
+  NextStates(const std::vector<int> &states, int char_class) const;
+
+ private:
+  /**
+   * Split the alphabet into classes. Every character below
+   * CharClassMap<T>::kTableSize and every boundary of char ranges and
+   * ranges starts a new interval. Intervals that behave identically for all
+   * states are merged into one class.
+   *
+   * @param nfa
+   */
+  void CharClassesInit(const Nfa<T> &nfa);
+
+  /**
+   * Whether the single character functional state in nfa matches c.
+   *
+   * @param nfa
+   * @param state a special pattern state or a range state
+   * @param c
+   * @return
+   */
+  static bool IsFuncStateMatched(const Nfa<T> &nfa, int state, T c);
+
+  CharClassMap<T> char_classes_;
+  int class_num_{0};
+
+  // a character of every class
+  std::vector<T> representatives_;
+
+  std::vector<std::vector<int>> empty_edges_;
+
+  // char_edges_[state][char_class] -- reachable states
+  std::vector<std::vector<std::vector<int>>> char_edges_;
+
+  int begin_state_{-1};
+  int accept_state_{-1};
+  // tag of every state
+  std::vector<int> tags_;
+};
+
+/**
+ * A DFA that is built on demand. DFA states are created the first time
+ * they are reached and every transition is cached, so a character that
+ * leads to a known state costs one table lookup. The states are cached in
+ * the DfaCache of a MatchScratch, so the DFA itself is never written and
+ * can be shared by threads with their own scratches.
+ */
+template<class T>
+class LazyDfa {
+ public:
+  static constexpr int kDefaultMaxStates = 10000;
+
+  static bool IsSupported(const Nfa<T> &nfa) {
+    return ClassNfa<T>::IsSupported(nfa);
+  }
+
+  /**
+   * @param nfa IsSupported(nfa) must be true
+   * @param max_states upper bound of cached DFA states
+   */
+  explicit LazyDfa(const Nfa<T> &nfa, int max_states = kDefaultMaxStates)
+          : nfa_(nfa), max_states_(max_states),
+            id_(DfaCache::NewOwner()) {}
+
+  /**
+   * Find the longest match which starts from begin in the range of
+   * [begin, end). It behaves the same as Nfa<T>::NextMatch.
+   *
+   * @param begin
+   * @param end
+   * @param match_end end of the match. It is only set when a match exists.
+   * @return whether a match exists
+   */
+  bool NextMatch(StrConstIt<T> begin, StrConstIt<T> end,
+                 StrConstIt<T> &match_end) const {
+    MatchScratch<T> scratch;
+    return NextMatch(begin, end, match_end, scratch);
+  }
+
+  /**
+   * The same as NextMatch(begin, end, match_end), but states are cached in
+   * scratch, so later calls with it reuse them.
+   */
+  bool NextMatch(StrConstIt<T> begin, StrConstIt<T> end,
+                 StrConstIt<T> &match_end, MatchScratch<T> &scratch) const;
+
+  /**
+   * Find the leftmost match in the range of [begin, end) in a single pass.
+   * It behaves the same as Nfa<T>::Search. Several DFA states are walked at
+   * once, one for every beginning that may still win. Notice that the
+   * cache may hold more than max_states states during a search since it is
+   * only cleared between two characters.
+   *
+   * @param begin
+   * @param end
+   * @param match It is only set when a match exists.
+   * @param prefilter the same as the one of Nfa<T>::Search
+   * @return whether a match exists
+   */
+  bool Search(StrConstIt<T> begin, StrConstIt<T> end, SubMatch<T> &match,
+              const Prefilter<T> *prefilter = nullptr) const {
+    MatchScratch<T> scratch;
+    return Search(begin, end, match, scratch, prefilter);
+  }
+
+  /**
+   * The same as Search(begin, end, match, prefilter), but states are cached
+   * in scratch.
+   */
+  bool Search(StrConstIt<T> begin, StrConstIt<T> end, SubMatch<T> &match,
+              MatchScratch<T> &scratch,
+              const Prefilter<T> *prefilter = nullptr) const;
+
+ private:
+  /**
+   * @return the cache of scratch. It is reset if it holds states of another
+   * automaton.
+   */
+  DfaCache &GetCache(MatchScratch<T> &scratch) const;
+
+  ClassNfa<T> nfa_;
+  int max_states_;
+  // owner of the states in caches. A copy has the same states, so it keeps
+  // the id.
+  std::uint64_t id_;
+};
+
+/**
+ * A DFA built ahead of time. It runs the full subset construction on a
+ * ClassNfa and minimizes the result with Hopcroft's algorithm. Transitions
+ * are stored in a dense row-major table indexed by character class. Every
+ * entry is premultiplied by the number of classes, so it is the offset of
+ * the next state's row.
+ */
+template<class T>
+class Dfa {
+ public:
+  static constexpr int kDefaultMaxStates = 10000;
+
+  /**
+   * Create an empty DFA.
+   */
+  Dfa() = default;
+
+  /**
+   * Build a minimized DFA for nfa. If nfa isn't supported by ClassNfa or
+   * the subset construction creates more than max_states states, it stops
+   * and creates an empty DFA.
+   *
+   * @param nfa
+   * @param max_states upper bound of states before minimization
+   */
+  explicit Dfa(const Nfa<T> &nfa, int max_states = kDefaultMaxStates)
+          : Dfa(nfa, {}, max_states) {}
+
+  /**
+   * Build a minimized DFA whose accept states tell which tagged states of
+   * nfa they hold, e.g. which rule of a lexer is matched. A DFA state is
+   * an accept state if it holds any tagged state, and its tag is the
+   * smallest one it holds, so earlier tagged states have priority.
+   *
+   * @param nfa
+   * @param tagged_states the same as the one of ClassNfa. If it is empty,
+   * accept states are those holding the accept state of nfa and their tags
+   * are 0.
+   * @param max_states upper bound of states before minimization
+   */
+  Dfa(const Nfa<T> &nfa, const std::vector<int> &tagged_states,
+      int max_states = kDefaultMaxStates);
+
+  [[nodiscard]] bool Empty() const {
+    return transitions_.empty();
+  }
+
+  [[nodiscard]] int GetStateNum() const {
+    return class_num_ == 0 ? 0 : transitions_.size() / class_num_;
+  }
+
+  /**
+   * Find the longest match which starts from begin in the range of
+   * [begin, end). It behaves the same as Nfa<T>::NextMatch.
+   *
+   * @param begin
+   * @param end
+   * @param match_end end of the match. It is only set when a match exists.
+   * @return whether a match exists
+   */
+  bool NextMatch(StrConstIt<T> begin, StrConstIt<T> end,
+                 StrConstIt<T> &match_end) const;
+
+  /**
+   * Find the longest match which starts from begin like NextMatch, and the
+   * tag of the accept state where it ends.
+   *
+   * @param begin
+   * @param end
+   * @param match_end It is only set when a match exists.
+   * @param tag It is only set when a match exists.
+   * @return whether a match exists
+   */
+  bool NextMatch(StrConstIt<T> begin, StrConstIt<T> end,
+                 StrConstIt<T> &match_end, int &tag) const;
+
+  /**
+   * Find the leftmost match in the range of [begin, end) in a single pass.
+   * It behaves the same as Nfa<T>::Search.
+   *
+   * @param begin
+   * @param end
+   * @param match It is only set when a match exists.
+   * @param prefilter the same as the one of Nfa<T>::Search
+   * @return whether a match exists
+   */
+  bool Search(StrConstIt<T> begin, StrConstIt<T> end, SubMatch<T> &match,
+              const Prefilter<T> *prefilter = nullptr) const {
+    MatchScratch<T> scratch;
+    return Search(begin, end, match, scratch, prefilter);
+  }
+
+  /**
+   * The same as Search(begin, end, match, prefilter), but threads are kept
+   * in scratch.
+   */
+  bool Search(StrConstIt<T> begin, StrConstIt<T> end, SubMatch<T> &match,
+              MatchScratch<T> &scratch,
+              const Prefilter<T> *prefilter = nullptr) const;
+
+  /**
+   * Find the leftmost non-empty match in a single pass like Search, and the
+   * tag of the accept state where it ends. It is the first token of a
+   * lexer, so an empty match is never a match.
+   *
+   * @param begin
+   * @param end
+   * @param match It is only set when a match exists.
+   * @param tag It is only set when a match exists.
+   * @param scratch
+   * @return whether a match exists
+   */
+  bool Search(StrConstIt<T> begin, StrConstIt<T> end, SubMatch<T> &match,
+              int &tag, MatchScratch<T> &scratch) const;
+
+ private:
+  static constexpr int kDeadState = 0;
+
+  /**
+   * Search with DfaSearch.
+   *
+   * @param match_state the accept state where the match ends
+   */
+  bool Search(StrConstIt<T> begin, StrConstIt<T> end, SubMatch<T> &match,
+              MatchScratch<T> &scratch, const Prefilter<T> *prefilter,
+              bool is_empty_allowed, int &match_state) const;
+
+  /**
+   * Run the subset construction.
+   *
+   * @param nfa
+   * @param max_states
+   * @param transitions next state of every state and character class
+   * @return false if more than max_states states are created
+   */
+  bool SubsetConstruct(const ClassNfa<T> &nfa, bool is_tagged,
+                       int max_states,
+                       std::vector<std::vector<int>> &transitions);
+
+  /**
+   * Merge equivalent states with Hopcroft's algorithm and fill
+   * transitions_.
+   *
+   * @param transitions next state of every state and character class. The
+   * dead state should be 0.
+   */
+  void Minimize(const std::vector<std::vector<int>> &transitions);
+
+  CharClassMap<T> char_classes_;
+  int class_num_{0};
+  // States are all premultiplied by class_num_.
+  int start_state_{kDeadState};
+  // Accept states are numbered after all other states, so a state is an
+  // accept state if it is no less than first_accept_state_.
+  int first_accept_state_{0};
+
+  // tags_[(state - first_accept_state_) / class_num_] -- tag of an accept
+  // state
+  std::vector<int> tags_;
+
+  // tag of every state or kNoTag. It is only used during the construction.
+  std::vector<int> accept_tags_;
+  // transitions_[state + char_class] -- next state
+  std::vector<int> transitions_;
+};
+
+/**
+ * Find the leftmost match by walking a DFA from every location at once.
+ * Every walk is a thread holding its beginning and its DFA state. Threads
+ * are sorted by their beginnings and a thread is dropped when an earlier
+ * thread is in the same state, since it can never win. A thread is added
+ * at every location until a thread is accepted, and threads after the
+ * accepted thread are dropped. The last accepted thread is the leftmost
+ * and longest match.
+ *
+ * @param begin
+ * @param end
+ * @param start_state
+ * @param dead_state
+ * @param transit returns the next state of a state and a character
+ * @param is_accepted tells whether a state is an accept state
+ * @param before_step called with all threads before every character
+ * @param prefilter Locations out of its candidates are skipped when no thread
+ * is alive. It can be nullptr.
+ * @param is_empty_allowed whether an empty match is a match
+ * @param scratch Threads are kept in it.
+ * @param match It is only set when a match exists.
+ * @param match_state the accept state where the match ends. It is only set
+ * when a match exists.
+ * @return whether a match exists
+ */
+template<class T, class Transit, class IsAccepted, class BeforeStep>
+bool DfaSearch(StrConstIt<T> begin, StrConstIt<T> end, int start_state,
+               int dead_state, Transit transit, IsAccepted is_accepted,
+               BeforeStep before_step, const Prefilter<T> *prefilter,
+               bool is_empty_allowed, MatchScratch<T> &scratch,
+               SubMatch<T> &match, int &match_state) {
+  using namespace std;
+
+  auto &threads = scratch.dfa_threads_;
+  auto &next_threads = scratch.dfa_next_threads_;
+  auto &step_of_state = scratch.dfa_step_of_state_;
+  threads.clear();
+  bool is_matched = false;
+  // locations before it are known to be candidates of prefilter
+  auto candidates_end = begin;
+
+  for (auto cur = begin; cur != end; ++cur) {
+    if (!is_matched) {
+      if (prefilter != nullptr && threads.empty() && cur >= candidates_end) {
+        auto candidates = prefilter->Find(cur, end);
+        if (candidates.first == end) {
+          break;
+        }
+        cur = candidates.first;
+        candidates_end = candidates.second;
+      }
+      if (is_empty_allowed && is_accepted(start_state)) {
+        is_matched = true;
+        match = {cur, cur};
+        match_state = start_state;
+      }
+      if (find_if(threads.cbegin(), threads.cend(), [start_state](auto &t) {
+        return t.second == start_state;
+      }) == threads.cend()) {
+        threads.emplace_back(cur, start_state);
+      }
+    }
+    if (threads.empty()) {
+      break;
+    }
+
+    before_step(threads);
+    if (scratch.dfa_step_ == INT_MAX) {
+      scratch.dfa_step_ = -1;
+      fill(step_of_state.begin(), step_of_state.end(), -1);
+    }
+    int step = ++scratch.dfa_step_;
+    next_threads.clear();
+    for (auto &[thread_begin, state]:threads) {
+      int next_state = transit(state, *cur);
+      if (next_state >= static_cast<int>(step_of_state.size())) {
+        step_of_state.resize(next_state + 1, -1);
+      }
+      if (next_state == dead_state || step_of_state[next_state] == step) {
+        continue;
+      }
+      step_of_state[next_state] = step;
+      next_threads.emplace_back(thread_begin, next_state);
+      if (is_accepted(next_state)) {
+        is_matched = true;
+        match = {thread_begin, cur + 1};
+        match_state = next_state;
+        break;
+      }
+    }
+    swap(threads, next_threads);
+  }
+
+  return is_matched;
+}
+
+template<class T>
+bool ClassNfa<T>::IsSupported(const Nfa<T> &nfa) {
+  return !nfa.Empty() && nfa.assertion_nfas_.empty() &&
+         nfa.tags_.empty() && nfa.counters_.empty() &&
+         !nfa.HasBackReference();
+}
+
+template<class T>
+ClassNfa<T>::ClassNfa(const Nfa<T> &nfa,
+                      const std::vector<int> &tagged_states) {
+  using namespace std;
+
+  CharClassesInit(nfa);
+
+  // States of a frozen NFA are already numbered from 0.
+  int state_num = nfa.GetStateNum();
+  begin_state_ = nfa.begin_state_;
+  accept_state_ = nfa.accept_state_;
+  tags_.assign(state_num, kNoTag);
+  for (int i = 0; i < static_cast<int>(tagged_states.size()); ++i) {
+    if (tagged_states[i] >= 0) {
+      tags_[tagged_states[i]] = i;
+    }
+  }
+
+  // range of every character class in nfa
+  vector<int> locations(class_num_);
+  for (int i = 0; i < class_num_; ++i) {
+    locations[i] = nfa.GetCharLocation(representatives_[i]);
+  }
+
+  empty_edges_.resize(state_num);
+  char_edges_.assign(state_num, vector<vector<int>>(class_num_));
+  for (int state = 0; state < state_num; ++state) {
+    auto empty_edges = nfa.GetEmptyEdges(state);
+
+    if (nfa.GetStateType(state) == Nfa<T>::StateType::kCommon) {
+      empty_edges_[state].assign(empty_edges.begin(), empty_edges.end());
+      for (int i = 0; i < class_num_; ++i) {
+        if (locations[i] <= Nfa<T>::kEmptyEdge) {
+          continue;
+        }
+        for (const auto &edge:nfa.GetEdges(state)) {
+          if (edge.char_range == locations[i]) {
+            char_edges_[state][i].push_back(edge.next_state);
+          }
+        }
+      }
+    } else {
+      // Empty edges of a functional state can only be used after it
+      // consumes a character.
+      for (int i = 0; i < class_num_; ++i) {
+        if (IsFuncStateMatched(nfa, state, representatives_[i])) {
+          char_edges_[state][i].assign(empty_edges.begin(),
+                                       empty_edges.end());
+        }
+      }
+    }
+  }
+}
+
+template<class T>
+void ClassNfa<T>::CharClassesInit(const Nfa<T> &nfa) {
+  using namespace std;
+
+  set<unsigned int> boundaries;
+  for (unsigned int c = 0; c <= CharClassMap<T>::kTableSize; ++c) {
+    boundaries.insert(c);
+  }
+  for (auto c:nfa.char_ranges_) {
+    boundaries.insert(c);
+  }
+  for (const auto &range_nfa:nfa.range_nfas_) {
+    for (const auto &range:range_nfa.ranges_) {
+      boundaries.insert(range.first);
+      boundaries.insert(range.second + 1);
+    }
+  }
+
+  // Characters in an interval behave the same, so a representative is
+  // enough to get the signature of the interval.
+  map<vector<int>, int> signatures;
+  vector<int> classes;
+  for (auto boundary:boundaries) {
+    T c = static_cast<T>(boundary);
+    vector<int> signature{nfa.GetCharLocation(c)};
+    for (int state = 0; state < nfa.GetStateNum(); ++state) {
+      if (nfa.GetStateType(state) != Nfa<T>::StateType::kCommon) {
+        signature.push_back(IsFuncStateMatched(nfa, state, c));
+      }
+    }
+
+    auto it = signatures.find(signature);
+    if (it == signatures.end()) {
+      it = signatures.emplace(signature, class_num_++).first;
+      representatives_.push_back(c);
+    }
+    classes.push_back(it->second);
+  }
+
+  char_classes_ = CharClassMap<T>(
+          vector<unsigned int>(boundaries.cbegin(), boundaries.cend()),
+          classes);
+}
+
+template<class T>
+bool ClassNfa<T>::IsFuncStateMatched(const Nfa<T> &nfa, int state, T c) {
+  using namespace std;
+
+  basic_string<T> s(1, c);
+
+  auto [state_type, payload] = nfa.state_infos_[state];
+  if (state_type == Nfa<T>::StateType::kSpecialPattern) {
+    return nfa.special_pattern_nfas_[payload].NextMatch(s.cbegin(),
+                                                        s.cend()) !=
+           s.cbegin();
+  }
+  return nfa.range_nfas_[payload].NextMatch(s.cbegin(), s.cend()) !=
+         s.cbegin();
+}
+
+template<class T>
+std::vector<int> ClassNfa<T>::Closure(const std::vector<int> &states) const {
+  using namespace std;
+
+  vector<bool> visited(empty_edges_.size());
+  vector<int> stack;
+  for (auto state:states) {
+    if (!visited[state]) {
+      visited[state] = true;
+      stack.push_back(state);
+    }
+  }
+
+  vector<int> closure;
+  while (!stack.empty()) {
+    int state = stack.back();
+    stack.pop_back();
+    closure.push_back(state);
+    for (auto next_state:empty_edges_[state]) {
+      if (!visited[next_state]) {
+        visited[next_state] = true;
+        stack.push_back(next_state);
+      }
+    }
+  }
+  sort(closure.begin(), closure.end());
+
+  return closure;
+}
+
+template<class T>
+std::vector<int>
+ClassNfa<T>::NextStates(const std::vector<int> &states, int char_class) const {
+  using namespace std;
+
+  vector<int> next_states;
+  for (auto state:states) {
+    const auto &edges = char_edges_[state][char_class];
+    next_states.insert(next_states.end(), edges.cbegin(), edges.cend());
+  }
+
+  return Closure(next_states);
+}
+
+template<class T>
+bool LazyDfa<T>::NextMatch(StrConstIt<T> begin, StrConstIt<T> end,
+                           StrConstIt<T> &match_end,
+                           MatchScratch<T> &scratch) const {
+  auto &cache = GetCache(scratch);
+  int state = cache.GetStartState();
+  bool is_matched = false;
+
+  if (cache.IsAccepted(state)) {
+    is_matched = true;
+    match_end = begin;
+  }
+  // find the longest match
+  while (begin != end && state != DfaCache::kDeadState) {
+    int char_class = nfa_.GetCharClass(*begin++);
+    int next_state = cache.GetNextState(state, char_class);
+    if (next_state == DfaCache::kUnknownState) {
+      next_state = cache.Transit(nfa_, state, char_class);
+    }
+    state = next_state;
+
+    if (cache.IsAccepted(state)) {
+      is_matched = true;
+      match_end = begin;
+    }
+  }
+
+  return is_matched;
+}
+
+template<class T>
+bool LazyDfa<T>::Search(StrConstIt<T> begin, StrConstIt<T> end,
+                        SubMatch<T> &match, MatchScratch<T> &scratch,
+                        const Prefilter<T> *prefilter) const {
+  using namespace std;
+
+  auto &cache = GetCache(scratch);
+  auto transit = [this, &cache](int state, T c) {
+    int char_class = nfa_.GetCharClass(c);
+    int next_state = cache.GetNextState(state, char_class);
+    if (next_state == DfaCache::kUnknownState) {
+      next_state = cache.Transit(nfa_, state, char_class, false);
+    }
+    return next_state;
+  };
+  auto is_accepted = [&cache](int state) {
+    return cache.IsAccepted(state);
+  };
+  // Clearing the cache changes ids of states, so all threads are moved to
+  // the new cache.
+  auto before_step = [this, &cache](
+          vector<pair<StrConstIt<T>, int>> &threads) {
+    if (!cache.IsFull()) {
+      return;
+    }
+    vector<vector<int>> nfa_states;
+    for (auto &thread:threads) {
+      nfa_states.push_back(cache.GetNfaStates(thread.second));
+    }
+    cache.Clear();
+    for (std::size_t i = 0; i < threads.size(); ++i) {
+      threads[i].second = cache.GetState(nfa_, nfa_states[i]);
+    }
+  };
+
+  int match_state;
+  return DfaSearch<T>(begin, end, cache.GetStartState(), DfaCache::kDeadState,
+                      transit, is_accepted, before_step, prefilter, true,
+                      scratch, match, match_state);
+}
+
+template<class T>
+DfaCache &LazyDfa<T>::GetCache(MatchScratch<T> &scratch) const {
+  auto &cache = scratch.dfa_cache_;
+  if (cache.GetOwner() != id_) {
+    cache.Reset(nfa_, id_, max_states_);
+  }
+  return cache;
+}
+
+template<class T>
+Dfa<T>::Dfa(const Nfa<T> &nfa, const std::vector<int> &tagged_states,
+            int max_states) {
+  using namespace std;
+
+  if (!ClassNfa<T>::IsSupported(nfa)) {
+    return;
+  }
+
+  ClassNfa<T> class_nfa(nfa, tagged_states);
+  char_classes_ = class_nfa.GetCharClassMap();
+  class_num_ = class_nfa.GetClassNum();
+
+  vector<vector<int>> transitions;
+  if (SubsetConstruct(class_nfa, !tagged_states.empty(), max_states,
+                      transitions)) {
+    Minimize(transitions);
+  }
+  accept_tags_.clear();
+}
+
+template<class T>
+bool Dfa<T>::NextMatch(StrConstIt<T> begin, StrConstIt<T> end,
+                       StrConstIt<T> &match_end) const {
+  if (Empty()) {
+    return false;
+  }
+
+  int state = start_state_;
+  bool is_matched = false;
+
+  if (state >= first_accept_state_) {
+    is_matched = true;
+    match_end = begin;
+  }
+  // find the longest match
+  while (begin != end && state != kDeadState) {
+    state = transitions_[state + char_classes_(*begin++)];
+    if (state >= first_accept_state_) {
+      is_matched = true;
+      match_end = begin;
+    }
+  }
+
+  return is_matched;
+}
+
+template<class T>
+bool Dfa<T>::NextMatch(StrConstIt<T> begin, StrConstIt<T> end,
+                       StrConstIt<T> &match_end, int &tag) const {
+  if (Empty()) {
+    return false;
+  }
+
+  int state = start_state_;
+  int accept_state = kDeadState;
+
+  if (state >= first_accept_state_) {
+    accept_state = state;
+    match_end = begin;
+  }
+  // find the longest match
+  while (begin != end && state != kDeadState) {
+    state = transitions_[state + char_classes_(*begin++)];
+    if (state >= first_accept_state_) {
+      accept_state = state;
+      match_end = begin;
+    }
+  }
+
+  if (accept_state == kDeadState) {
+    return false;
+  }
+  tag = tags_[(accept_state - first_accept_state_) / class_num_];
+  return true;
+}
+
+template<class T>
+bool Dfa<T>::Search(StrConstIt<T> begin, StrConstIt<T> end,
+                    SubMatch<T> &match, MatchScratch<T> &scratch,
+                    const Prefilter<T> *prefilter) const {
+  int match_state;
+  return Search(begin, end, match, scratch, prefilter, true, match_state);
+}
+
+template<class T>
+bool Dfa<T>::Search(StrConstIt<T> begin, StrConstIt<T> end,
+                    SubMatch<T> &match, int &tag,
+                    MatchScratch<T> &scratch) const {
+  int match_state;
+  if (!Search(begin, end, match, scratch, nullptr, false, match_state)) {
+    return false;
+  }
+  tag = tags_[(match_state - first_accept_state_) / class_num_];
+  return true;
+}
+
+template<class T>
+bool Dfa<T>::Search(StrConstIt<T> begin, StrConstIt<T> end,
+                    SubMatch<T> &match, MatchScratch<T> &scratch,
+                    const Prefilter<T> *prefilter, bool is_empty_allowed,
+                    int &match_state) const {
+  using namespace std;
+
+  if (Empty()) {
+    return false;
+  }
+
+  return DfaSearch<T>(
+          begin, end, start_state_, kDeadState,
+          [this](int state, T c) {
+            return transitions_[state + char_classes_(c)];
+          },
+          [this](int state) { return state >= first_accept_state_; },
+          [](vector<pair<StrConstIt<T>, int>> &) {}, prefilter,
+          is_empty_allowed, scratch, match, match_state);
+}
+
+template<class T>
+bool Dfa<T>::SubsetConstruct(const ClassNfa<T> &nfa, bool is_tagged,
+                             int max_states,
+                             std::vector<std::vector<int>> &transitions) {
+  using namespace std;
+
+  map<vector<int>, int> state_ids;
+  vector<vector<int>> states;
+  auto get_state = [&](const vector<int> &nfa_states) {
+    auto it = state_ids.find(nfa_states);
+    if (it == state_ids.end()) {
+      it = state_ids.emplace(nfa_states, states.size()).first;
+      states.push_back(nfa_states);
+
+      int tag = ClassNfa<T>::kNoTag;
+      if (is_tagged) {
+        for (auto nfa_state:nfa_states) {
+          int state_tag = nfa.GetTag(nfa_state);
+          if (state_tag != ClassNfa<T>::kNoTag &&
+              (tag == ClassNfa<T>::kNoTag || state_tag < tag)) {
+            tag = state_tag;
+          }
+        }
+      } else if (binary_search(nfa_states.cbegin(), nfa_states.cend(),
+                               nfa.GetAcceptState())) {
+        tag = 0;
+      }
+      accept_tags_.push_back(tag);
+    }
+    return it->second;
+  };
+
+  get_state(vector<int>());  // dead state
+  start_state_ = get_state(nfa.Closure({nfa.GetBeginState()}));
+
+  // States are numbered in the order they are found, so every state before
+  // 'state' has all its transitions.
+  for (int state = 0; state < static_cast<int>(states.size()); ++state) {
+    transitions.emplace_back(class_num_);
+    for (int i = 0; i < class_num_; ++i) {
+      transitions[state][i] = get_state(nfa.NextStates(states[state], i));
+      if (static_cast<int>(states.size()) > max_states) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+template<class T>
+void Dfa<T>::Minimize(const std::vector<std::vector<int>> &transitions) {
+  using namespace std;
+
+  int state_num = transitions.size();
+
+  // reverse_edges[char_class][state] -- states that reach 'state' through
+  // 'char_class'
+  vector<vector<vector<int>>> reverse_edges(
+          class_num_, vector<vector<int>>(state_num));
+  for (int state = 0; state < state_num; ++state) {
+    for (int i = 0; i < class_num_; ++i) {
+      reverse_edges[i][transitions[state][i]].push_back(state);
+    }
+  }
+
+  // The initial partition splits accept states from others, and accept
+  // states with different tags from each other. The dead state is always
+  // in block 0.
+  vector<vector<int>> blocks(1);
+  vector<int> block_of(state_num);
+  map<int, int> tag_blocks;
+  for (int state = 0; state < state_num; ++state) {
+    int tag = accept_tags_[state];
+    if (tag != ClassNfa<T>::kNoTag) {
+      auto [it, is_new] = tag_blocks.emplace(tag, blocks.size());
+      if (is_new) {
+        blocks.emplace_back();
+      }
+      block_of[state] = it->second;
+    }
+    blocks[block_of[state]].push_back(state);
+  }
+
+  // Blocks waiting to be used as splitters. Every splitter is tried with
+  // all character classes.
+  vector<bool> is_waiting(blocks.size(), true);
+  vector<int> waiting;
+  for (int i = 0; i < static_cast<int>(blocks.size()); ++i) {
+    waiting.push_back(i);
+  }
+
+  vector<int> marked_num;
+  vector<bool> is_marked(state_num);
+  while (!waiting.empty()) {
+    int splitter = waiting.back();
+    waiting.pop_back();
+    is_waiting[splitter] = false;
+    auto splitter_states = blocks[splitter];
+
+    for (int i = 0; i < class_num_; ++i) {
+      // mark states that reach the splitter through class i
+      vector<int> marked_states;
+      vector<int> touched_blocks;
+      marked_num.assign(blocks.size(), 0);
+      for (auto state:splitter_states) {
+        for (auto prev_state:reverse_edges[i][state]) {
+          if (!is_marked[prev_state]) {
+            is_marked[prev_state] = true;
+            marked_states.push_back(prev_state);
+            if (marked_num[block_of[prev_state]]++ == 0) {
+              touched_blocks.push_back(block_of[prev_state]);
+            }
+          }
+        }
+      }
+
+      // split blocks that are partially marked
+      for (auto block:touched_blocks) {
+        if (marked_num[block] == static_cast<int>(blocks[block].size())) {
+          continue;
+        }
+        int new_block = blocks.size();
+        vector<int> unmarked_states;
+        blocks.emplace_back();
+        for (auto state:blocks[block]) {
+          if (is_marked[state]) {
+            blocks[new_block].push_back(state);
+            block_of[state] = new_block;
+          } else {
+            unmarked_states.push_back(state);
+          }
+        }
+        blocks[block] = unmarked_states;
+
+        if (is_waiting[block] ||
+            blocks[new_block].size() <= blocks[block].size()) {
+          is_waiting.push_back(true);
+          waiting.push_back(new_block);
+        } else {
+          is_waiting.push_back(false);
+          is_waiting[block] = true;
+          waiting.push_back(block);
+        }
+      }
+
+      for (auto state:marked_states) {
+        is_marked[state] = false;
+      }
+    }
+  }
+
+  // Renumber blocks. The block of the dead state becomes 0 and accept
+  // blocks are put at the end.
+  vector<int> new_ids(blocks.size(), -1);
+  int block_num = 0;
+  new_ids[block_of[kDeadState]] = block_num++;
+  for (std::size_t i = 0; i < blocks.size(); ++i) {
+    if (new_ids[i] == -1 &&
+        accept_tags_[blocks[i][0]] == ClassNfa<T>::kNoTag) {
+      new_ids[i] = block_num++;
+    }
+  }
+  first_accept_state_ = block_num * class_num_;
+  int first_accept_block = block_num;
+  tags_.assign(blocks.size() - block_num, ClassNfa<T>::kNoTag);
+  for (std::size_t i = 0; i < blocks.size(); ++i) {
+    if (new_ids[i] == -1) {
+      tags_[block_num - first_accept_block] = accept_tags_[blocks[i][0]];
+      new_ids[i] = block_num++;
+    }
+  }
+
+  transitions_.assign(block_num * class_num_, kDeadState);
+  for (std::size_t i = 0; i < blocks.size(); ++i) {
+    int state = blocks[i][0];
+    for (int j = 0; j < class_num_; ++j) {
+      transitions_[new_ids[i] * class_num_ + j] =
+              new_ids[block_of[transitions[state][j]]] * class_num_;
+    }
+  }
+  start_state_ = new_ids[block_of[start_state_]] * class_num_;
+}
+}
+
+#endif //XYREGENGINE_DFA_H
@@ -0,0 +1,272 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#ifndef XYREGENGINE_DFA_CACHE_H
+#define XYREGENGINE_DFA_CACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <vector>
+
+namespace XyRegEngine {
+template<class T>
+class ClassNfa;
+
+/**
+ * States of a DFA built on demand from a ClassNfa by the subset
+ * construction. Every transition is cached in a table indexed by character
+ * class, so a character that leads to a known state costs one table
+ * lookup. When the cache holds too many states, it is cleared except the
+ * dead state and the start state. An unanchored cache adds the start state
+ * to every state, so it walks all beginnings at once.
+ *
+ * The cache of a lazy DFA lives in a MatchScratch instead of the DFA, so a
+ * DFA used by several threads is never written. A cache remembers the
+ * automaton it is filled for and is reset when a scratch is passed to
+ * another one.
+ */
+class DfaCache {
+ public:
+  static constexpr int kUnknownState = -1;
+  static constexpr int kDeadState = 0;
+
+  /**
+   * @return an id for a new automaton. Ids are never reused, so a cache of
+   * a destroyed automaton is never taken for another one.
+   */
+  static std::uint64_t NewOwner() {
+    static std::atomic<std::uint64_t> next_owner{1};
+    return next_owner++;
+  }
+
+  /**
+   * @return id of the automaton whose states are cached, or 0 if none
+   */
+  [[nodiscard]] std::uint64_t GetOwner() const {
+    return owner_;
+  }
+
+  /**
+   * Remove all states and create the dead state and the start state of nfa.
+   *
+   * @param nfa
+   * @param owner id of the automaton built on nfa
+   * @param max_states upper bound of cached states
+   * @param is_anchored whether matches only begin at the start
+   */
+  template<class T>
+  void Reset(const ClassNfa<T> &nfa, std::uint64_t owner, int max_states,
+             bool is_anchored = true);
+
+  [[nodiscard]] int GetStartState() const {
+    return start_state_;
+  }
+
+  [[nodiscard]] int GetStateNum() const {
+    return static_cast<int>(states_.size());
+  }
+
+  /**
+   * @return whether the cache should be cleared before a new state is added
+   */
+  [[nodiscard]] bool IsFull() const {
+    return GetStateNum() >= max_states_;
+  }
+
+  [[nodiscard]] bool IsAccepted(int state) const {
+    return accept_states_[state];
+  }
+
+  /**
+   * @param state
+   * @return tags of the tagged NFA states of state, e.g. regexes of a set
+   * accepted in it
+   */
+  [[nodiscard]] const std::vector<int> &GetTags(int state) const {
+    return tags_[state];
+  }
+
+  /**
+   * @param state
+   * @return the mark set by SetMark, or -1 if none is set since state is
+   * created
+   */
+  [[nodiscard]] int GetMark(int state) const {
+    return marks_[state];
+  }
+
+  /**
+   * Keep a number with state, e.g. the last search reaching it.
+   */
+  void SetMark(int state, int mark) {
+    marks_[state] = mark;
+  }
+
+  /**
+   * @param state
+   * @return sorted NFA states of state
+   */
+  [[nodiscard]] const std::vector<int> &GetNfaStates(int state) const {
+    return states_[state];
+  }
+
+  /**
+   * @param state
+   * @param char_class
+   * @return the cached next state, or kUnknownState if it isn't computed
+   */
+  [[nodiscard]] int GetNextState(int state, int char_class) const {
+    return transitions_[state * class_num_ + char_class];
+  }
+
+  /**
+   * Get the id of the DFA state consisting of 'nfa_states'. If it doesn't
+   * exist, create it with all transitions unknown.
+   *
+   * @param nfa the one passed to Reset
+   * @param nfa_states
+   * @return
+   */
+  template<class T>
+  int GetState(const ClassNfa<T> &nfa, const std::vector<int> &nfa_states);
+
+  /**
+   * Compute and cache the transition from 'state' through 'char_class'.
+   *
+   * @param nfa the one passed to Reset
+   * @param state
+   * @param char_class
+   * @param can_clear_cache whether the cache can be cleared when it is full
+   * @return the next state. Notice that ids of all states except the dead
+   * state and the start state may change if the cache is cleared.
+   */
+  template<class T>
+  int Transit(const ClassNfa<T> &nfa, int state, int char_class,
+              bool can_clear_cache = true);
+
+  /**
+   * Remove all cached states except the dead state and the start state.
+   */
+  void Clear();
+
+ private:
+  std::uint64_t owner_{0};
+  int max_states_{0};
+  int class_num_{0};
+  int start_state_{kUnknownState};
+  bool is_anchored_{true};
+  // closure of the begin state of the NFA
+  std::vector<int> start_nfa_states_;
+
+  std::map<std::vector<int>, int> state_ids_;
+  // NFA states of every DFA state
+  std::vector<std::vector<int>> states_;
+  std::vector<bool> accept_states_;
+  // tags of the NFA states of every DFA state
+  std::vector<std::vector<int>> tags_;
+  std::vector<int> marks_;
+  // transitions_[state * class_num_ + char_class] -- next state
+  std::vector<int> transitions_;
+};
+
+template<class T>
+void DfaCache::Reset(const ClassNfa<T> &nfa, std::uint64_t owner,
+                     int max_states, bool is_anchored) {
+  owner_ = owner;
+  max_states_ = max_states;
+  class_num_ = nfa.GetClassNum();
+  is_anchored_ = is_anchored;
+  start_nfa_states_ = nfa.Closure({nfa.GetBeginState()});
+  state_ids_.clear();
+  states_.clear();
+  accept_states_.clear();
+  tags_.clear();
+  marks_.clear();
+  transitions_.clear();
+  GetState(nfa, std::vector<int>());  // dead state
+  start_state_ = GetState(nfa, start_nfa_states_);
+}
+
+template<class T>
+int DfaCache::GetState(const ClassNfa<T> &nfa,
+                       const std::vector<int> &nfa_states) {
+  using namespace std;
+
+  auto it = state_ids_.find(nfa_states);
+  if (it != state_ids_.end()) {
+    return it->second;
+  }
+
+  int state = states_.size();
+  state_ids_.emplace(nfa_states, state);
+  states_.push_back(nfa_states);
+  accept_states_.push_back(binary_search(nfa_states.cbegin(),
+                                         nfa_states.cend(),
+                                         nfa.GetAcceptState()));
+  vector<int> tags;
+  for (auto nfa_state:nfa_states) {
+    int tag = nfa.GetTag(nfa_state);
+    if (tag != ClassNfa<T>::kNoTag) {
+      tags.push_back(tag);
+    }
+  }
+  tags_.push_back(std::move(tags));
+  marks_.push_back(-1);
+  if (state == kDeadState) {
+    // The dead state never leaves itself.
+    transitions_.insert(transitions_.end(), class_num_, kDeadState);
+  } else {
+    transitions_.insert(transitions_.end(), class_num_, kUnknownState);
+  }
+
+  return state;
+}
+
+template<class T>
+int DfaCache::Transit(const ClassNfa<T> &nfa, int state, int char_class,
+                      bool can_clear_cache) {
+  auto next_nfa_states = nfa.NextStates(states_[state], char_class);
+  if (!is_anchored_) {
+    std::vector<int> nfa_states;
+    std::set_union(next_nfa_states.cbegin(), next_nfa_states.cend(),
+                   start_nfa_states_.cbegin(), start_nfa_states_.cend(),
+                   std::back_inserter(nfa_states));
+    next_nfa_states = std::move(nfa_states);
+  }
+
+  if (can_clear_cache && IsFull() && !state_ids_.contains(next_nfa_states)) {
+    auto nfa_states = states_[state];
+    Clear();
+    state = GetState(nfa, nfa_states);
+  }
+  int next_state = GetState(nfa, next_nfa_states);
+  transitions_[state * class_num_ + char_class] = next_state;
+
+  return next_state;
+}
+
+inline void DfaCache::Clear() {
+  int reserved_states = start_state_ + 1;
+
+  for (int i = reserved_states; i < GetStateNum(); ++i) {
+    state_ids_.erase(states_[i]);
+  }
+  states_.resize(reserved_states);
+  accept_states_.resize(reserved_states);
+  tags_.resize(reserved_states);
+  marks_.resize(reserved_states);
+  transitions_.resize(reserved_states * class_num_);
+  for (int i = 0; i < reserved_states; ++i) {
+    if (i != kDeadState) {
+      std::fill(transitions_.begin() + i * class_num_,
+                transitions_.begin() + (i + 1) * class_num_, kUnknownState);
+    }
+  }
+}
+}
+
+#endif //XYREGENGINE_DFA_CACHE_H
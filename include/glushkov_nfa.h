@@ -0,0 +1,492 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#ifndef XYREGENGINE_GLUSHKOV_NFA_H
+#define XYREGENGINE_GLUSHKOV_NFA_H
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory_resource>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "char_class.h"
+#include "nfa.h"
+
+namespace XyRegEngine {
+/**
+ * A bit-parallel simulation of the Glushkov automaton of a small regex.
+ * Every character, special pattern and range in the regex is a position and
+ * all edges entering a position consume characters matched by it. Active
+ * positions are held in a single uint64_t, so a step is
+ *
+ * positions = Follow(positions) & class_masks_[class of c]
+ *
+ * where Follow is the union of follow sets of all active positions. It is
+ * looked up 8 positions a time in precomputed tables, so no allocation is
+ * needed during matching.
+ *
+ * Only regexes without groups, assertions and back-references and with at
+ * most kMaxPositions positions are supported. Counted repetitions are
+ * unrolled, so they are counted several times.
+ */
+template<class T>
+class GlushkovNfa {
+ public:
+  static constexpr int kMaxPositions = 64;
+
+  /**
+   * Build the automaton for 'regex'. If 'regex' is invalid or not
+   * supported, it creates an empty automaton.
+   *
+   * @param regex
+   */
+  explicit GlushkovNfa(const std::basic_string<T> &regex);
+
+  [[nodiscard]] bool Empty() const {
+    return follow_tables_.empty();
+  }
+
+  [[nodiscard]] int GetPositionNum() const {
+    return position_num_;
+  }
+
+  /**
+   * Find the longest match which starts from begin in the range of
+   * [begin, end). It behaves the same as Nfa<T>::NextMatch.
+   *
+   * @param begin
+   * @param end
+   * @param match_end end of the match. It is only set when a match exists.
+   * @return whether a match exists
+   */
+  bool NextMatch(StrConstIt<T> begin, StrConstIt<T> end,
+                 StrConstIt<T> &match_end) const;
+
+  /**
+   * Find the leftmost match in the range of [begin, end) in a single pass.
+   * It behaves the same as Nfa<T>::Search.
+   *
+   * Positions are grouped by the beginning of the walk reaching them and
+   * groups are sorted by their beginnings. A position is only kept in the
+   * earliest group reaching it, so groups never overlap and there are at
+   * most kMaxPositions groups.
+   *
+   * @param begin
+   * @param end
+   * @param match It is only set when a match exists.
+   * @param prefilter the same as the one of Nfa<T>::Search
+   * @return whether a match exists
+   */
+  bool Search(StrConstIt<T> begin, StrConstIt<T> end, SubMatch<T> &match,
+              const Prefilter<T> *prefilter = nullptr) const;
+
+ private:
+  static constexpr int kChunkBits = 8;
+  static constexpr int kChunkSize = 1 << kChunkBits;
+
+  /**
+   * Positions of a sub-expression that can be entered first and left last.
+   */
+  struct Fragment {
+    uint64_t first{0};
+    uint64_t last{0};
+    bool nullable{true};
+  };
+
+  /**
+   * Assign positions to all characters in the AST and fill follow sets.
+   *
+   * @param ast_head
+   * @param fragment positions of the AST
+   * @return false if the AST isn't supported
+   */
+  bool Compile(const AstNodePtr<T> &ast_head, Fragment &fragment);
+
+  /**
+   * @param left
+   * @param right
+   * @return the fragment matching left and then right
+   */
+  Fragment Concat(const Fragment &left, const Fragment &right);
+
+  /**
+   * Let the fragment repeat itself for any times.
+   *
+   * @param fragment
+   */
+  void Loop(const Fragment &fragment);
+
+  /**
+   * Split the alphabet into classes that have the same mask and fill
+   * char_classes_ and class_masks_.
+   */
+  void CharClassesInit();
+
+  /**
+   * @param characters a character, a special pattern or a range
+   * @return a function telling whether 'characters' matches a character
+   */
+  static std::function<bool(T)>
+  MakeMatcher(const std::basic_string<T> &characters);
+
+  [[nodiscard]] uint64_t Follow(uint64_t positions) const {
+    uint64_t next_positions = 0;
+    for (int i = 0; positions != 0; ++i, positions >>= kChunkBits) {
+      next_positions |= follow_tables_[i][positions & (kChunkSize - 1)];
+    }
+    return next_positions;
+  }
+
+  int position_num_{0};
+
+  // They are only used during the construction.
+  std::vector<std::basic_string<T>> positions_;
+  std::vector<uint64_t> follows_;
+
+  CharClassMap<T> char_classes_;
+  // class_masks_[char_class] -- positions matching characters in the class
+  std::vector<uint64_t> class_masks_;
+  // follow_tables_[i][chunk] -- union of follow sets of positions in chunk,
+  // which holds positions [i * kChunkBits, (i + 1) * kChunkBits)
+  std::vector<std::array<uint64_t, kChunkSize>> follow_tables_;
+
+  Fragment fragment_;
+};
+
+template<class T>
+GlushkovNfa<T>::GlushkovNfa(const std::basic_string<T> &regex) {
+  using namespace std;
+
+  pmr::monotonic_buffer_resource arena;
+  auto ast_head = Nfa<T>::ParseRegex(regex, &arena);
+  if (!ast_head || !Compile(ast_head, fragment_)) {
+    return;
+  }
+  position_num_ = positions_.size();
+
+  CharClassesInit();
+  positions_.clear();
+
+  // Every table is built from the one with the lowest bit cleared.
+  int chunk_num = (position_num_ + kChunkBits - 1) / kChunkBits;
+  follow_tables_.resize(max(chunk_num, 1));
+  for (int i = 0; i < chunk_num; ++i) {
+    auto &table = follow_tables_[i];
+    table[0] = 0;
+    for (int chunk = 1; chunk < kChunkSize; ++chunk) {
+      int position = i * kChunkBits + countr_zero(unsigned(chunk));
+      table[chunk] = table[chunk & (chunk - 1)];
+      if (position < position_num_) {
+        table[chunk] |= follows_[position];
+      }
+    }
+  }
+  follows_.clear();
+}
+
+template<class T>
+bool GlushkovNfa<T>::NextMatch(StrConstIt<T> begin, StrConstIt<T> end,
+                               StrConstIt<T> &match_end) const {
+  if (Empty()) {
+    return false;
+  }
+
+  bool is_matched = false;
+  if (fragment_.nullable) {
+    is_matched = true;
+    match_end = begin;
+  }
+  if (begin == end) {
+    return is_matched;
+  }
+
+  // find the longest match
+  uint64_t positions =
+          fragment_.first & class_masks_[char_classes_(*begin++)];
+  while (positions != 0) {
+    if (positions & fragment_.last) {
+      is_matched = true;
+      match_end = begin;
+    }
+    if (begin == end) {
+      break;
+    }
+    positions = Follow(positions) & class_masks_[char_classes_(*begin++)];
+  }
+
+  return is_matched;
+}
+
+template<class T>
+bool GlushkovNfa<T>::Search(StrConstIt<T> begin, StrConstIt<T> end,
+                            SubMatch<T> &match,
+                            const Prefilter<T> *prefilter) const {
+  using namespace std;
+
+  if (Empty()) {
+    return false;
+  }
+
+  // groups[i] -- beginning of the group and its positions
+  array<pair<StrConstIt<T>, uint64_t>, kMaxPositions> groups;
+  int group_num = 0;
+  bool is_matched = false;
+  // locations before it are known to be candidates of prefilter
+  auto candidates_end = begin;
+
+  for (auto cur = begin; cur != end; ++cur) {
+    if (prefilter != nullptr && group_num == 0 && !is_matched &&
+        cur >= candidates_end) {
+      auto candidates = prefilter->Find(cur, end);
+      if (candidates.first == end) {
+        break;
+      }
+      cur = candidates.first;
+      candidates_end = candidates.second;
+    }
+    // A group beginning at cur is added until a match is found.
+    bool is_injected = !is_matched;
+    if (is_injected && fragment_.nullable) {
+      is_matched = true;
+      match = {cur, cur};
+    }
+    if (group_num == 0 && !is_injected) {
+      break;
+    }
+
+    uint64_t mask = class_masks_[char_classes_(*cur)];
+    uint64_t reached_positions = 0;
+    int next_group_num = 0;
+    for (int i = 0; i < group_num; ++i) {
+      uint64_t positions = Follow(groups[i].second) & mask &
+                           ~reached_positions;
+      if (positions != 0) {
+        reached_positions |= positions;
+        groups[next_group_num++] = {groups[i].first, positions};
+      }
+    }
+    if (is_injected) {
+      uint64_t positions = fragment_.first & mask & ~reached_positions;
+      if (positions != 0) {
+        groups[next_group_num++] = {cur, positions};
+      }
+    }
+    group_num = next_group_num;
+
+    // Groups after the accepted group begin later, so they can never win.
+    for (int i = 0; i < group_num; ++i) {
+      if (groups[i].second & fragment_.last) {
+        is_matched = true;
+        match = {groups[i].first, cur + 1};
+        group_num = i + 1;
+        break;
+      }
+    }
+  }
+
+  return is_matched;
+}
+
+template<class T>
+bool GlushkovNfa<T>::Compile(const AstNodePtr<T> &ast_head,
+                             Fragment &fragment) {
+  using namespace std;
+
+  Fragment left, right;
+  switch (ast_head->regex_type_) {
+    case RegexPart::kChar: {
+      basic_string<T> characters(ast_head->regex_);
+      if (characters[0] == '[') {
+        for (const auto &special_pattern:
+                RangeNfa<T>(characters).special_patterns_) {
+          if (special_pattern.IsBackReference()) {
+            return false;
+          }
+        }
+      } else if (characters[0] == kReverseSolidus) {
+        if (SpecialPatternNfa<T>(characters).IsBackReference()) {
+          return false;
+        }
+      } else if (characters[0] == '\0') {
+        // Nfa sees '\0' as an empty edge.
+        return false;
+      }
+      if (positions_.size() == kMaxPositions) {
+        return false;
+      }
+
+      uint64_t position = uint64_t(1) << positions_.size();
+      positions_.push_back(std::move(characters));
+      follows_.push_back(0);
+      fragment = {position, position, false};
+      return true;
+    }
+    case RegexPart::kAlternative:
+      if (!Compile(ast_head->left_son_, left) ||
+          !Compile(ast_head->right_son_, right)) {
+        return false;
+      }
+      fragment = {left.first | right.first, left.last | right.last,
+                  left.nullable || right.nullable};
+      return true;
+    case RegexPart::kAnd:
+      if (!Compile(ast_head->left_son_, left) ||
+          !Compile(ast_head->right_son_, right)) {
+        return false;
+      }
+      fragment = Concat(left, right);
+      return true;
+    case RegexPart::kQuantifier: {
+      auto repeat_range = ast_head->repeat_range_;
+      if (repeat_range.first > repeat_range.second) {
+        return false;
+      }
+
+      // Every repetition needs its own positions, like the NFA does.
+      fragment = Fragment();
+      int i = 0;
+      for (; i < repeat_range.first; ++i) {
+        if (!Compile(ast_head->left_son_, left)) {
+          return false;
+        }
+        if (i == repeat_range.first - 1 && repeat_range.second == INT_MAX) {
+          // x{n,} is x{n-1}x+
+          Loop(left);
+        }
+        fragment = Concat(fragment, left);
+      }
+      if (repeat_range.second == INT_MAX) {
+        if (repeat_range.first == 0) {  // x*
+          if (!Compile(ast_head->left_son_, left)) {
+            return false;
+          }
+          Loop(left);
+          left.nullable = true;
+          fragment = left;
+        }
+        return true;
+      }
+      for (; i < repeat_range.second; ++i) {
+        if (!Compile(ast_head->left_son_, left)) {
+          return false;
+        }
+        left.nullable = true;
+        fragment = Concat(fragment, left);
+      }
+      return true;
+    }
+    default:  // groups and assertions
+      return false;
+  }
+}
+
+template<class T>
+typename GlushkovNfa<T>::Fragment
+GlushkovNfa<T>::Concat(const Fragment &left, const Fragment &right) {
+  for (std::size_t i = 0; i < positions_.size(); ++i) {
+    if (left.last & (uint64_t(1) << i)) {
+      follows_[i] |= right.first;
+    }
+  }
+
+  Fragment fragment;
+  fragment.first = left.nullable ? left.first | right.first : left.first;
+  fragment.last = right.nullable ? left.last | right.last : right.last;
+  fragment.nullable = left.nullable && right.nullable;
+  return fragment;
+}
+
+template<class T>
+void GlushkovNfa<T>::Loop(const Fragment &fragment) {
+  for (std::size_t i = 0; i < positions_.size(); ++i) {
+    if (fragment.last & (uint64_t(1) << i)) {
+      follows_[i] |= fragment.first;
+    }
+  }
+}
+
+template<class T>
+void GlushkovNfa<T>::CharClassesInit() {
+  using namespace std;
+
+  set<unsigned int> boundaries;
+  for (unsigned int c = 0; c <= CharClassMap<T>::kTableSize; ++c) {
+    boundaries.insert(c);
+  }
+  for (const auto &characters:positions_) {
+    if (characters.size() == 1 && characters[0] != kFullStop) {
+      boundaries.insert(CodePoint(characters[0]));
+      boundaries.insert(CodePoint(characters[0]) + 1);
+    } else if (characters[0] == '[') {
+      for (const auto &range:RangeNfa<T>(characters).ranges_) {
+        boundaries.insert(range.first);
+        boundaries.insert(range.second + 1);
+      }
+    }
+  }
+
+  vector<function<bool(T)>> matchers;
+  for (const auto &characters:positions_) {
+    matchers.push_back(MakeMatcher(characters));
+  }
+
+  // Characters in an interval behave the same, so a representative is
+  // enough to get the mask of the interval.
+  map<uint64_t, int> mask_classes;
+  vector<int> classes;
+  for (auto boundary:boundaries) {
+    T c = static_cast<T>(boundary);
+    uint64_t mask = 0;
+    for (std::size_t i = 0; i < matchers.size(); ++i) {
+      if (matchers[i](c)) {
+        mask |= uint64_t(1) << i;
+      }
+    }
+
+    auto it = mask_classes.find(mask);
+    if (it == mask_classes.end()) {
+      it = mask_classes.emplace(mask, class_masks_.size()).first;
+      class_masks_.push_back(mask);
+    }
+    classes.push_back(it->second);
+  }
+
+  char_classes_ = CharClassMap<T>(
+          vector<unsigned int>(boundaries.cbegin(), boundaries.cend()),
+          classes);
+}
+
+template<class T>
+std::function<bool(T)>
+GlushkovNfa<T>::MakeMatcher(const std::basic_string<T> &characters) {
+  using namespace std;
+
+  if (characters.size() == 1 && characters[0] != kFullStop) {
+    T character = characters[0];
+    return [character](T c) { return c == character; };
+  }
+
+  // Special patterns and ranges match a string with a single character.
+  auto matches = [](const auto &nfa, T c) {
+    basic_string<T> s(1, c);
+    return nfa.NextMatch(s.cbegin(), s.cend()) != s.cbegin();
+  };
+  if (characters[0] == '[') {
+    return [range_nfa = RangeNfa<T>(characters), matches](T c) {
+      return matches(range_nfa, c);
+    };
+  }
+  return [special_pattern_nfa = SpecialPatternNfa<T>(characters),
+          matches](T c) {
+    return matches(special_pattern_nfa, c);
+  };
+}
+}
+
+#endif //XYREGENGINE_GLUSHKOV_NFA_H
@@ -5,6 +5,11 @@
 #ifndef XYREGENGINE_LEX_H
 #define XYREGENGINE_LEX_H
 
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <string_view>
+
 namespace XyRegEngine {
 // We use integer constants to replace string literals, so we can use a
 // common representation for literals.
@@ -29,14 +34,29 @@ template<class T>
 using StrConstIt = typename std::basic_string<T>::const_iterator;
 
 template<class T>
-std::basic_string<T> NextToken(StrConstIt<T> &begin, StrConstIt<T> &end) {
+StrConstIt<T> SkipEscapeCharacters(StrConstIt<T> begin, StrConstIt<T> end);
+
+/**
+ * @param c [ or {
+ * @return the right bracket closing c
+ */
+template<class T>
+constexpr T GetRightBracket(T c) {
+  return c == '[' ? ']' : '}';
+}
+
+template<class T>
+std::basic_string_view<T> NextToken(StrConstIt<T> &begin,
+                                    StrConstIt<T> &end) {
   using namespace std;
 
   if (begin != end) {
     auto cur_begin = begin;
-    std::map<char, char> pair_characters{
-            {'}', '{'},
-            {']', '['}
+    // The token is [cur_begin, token_end) of the regex, so it is never
+    // copied.
+    auto token = [&cur_begin](StrConstIt<T> token_end) {
+      return basic_string_view<T>(to_address(cur_begin),
+                                  token_end - cur_begin);
     };
 
     // count ( to ensure correct matches of nested ()
@@ -46,7 +66,7 @@ std::basic_string<T> NextToken(StrConstIt<T> &begin, StrConstIt<T> &end) {
       case '.':
       case '^':
       case '$':
-        return basic_string<T>(1, *begin++);
+        return token(++begin);
 
         // repeat(greedy and non-greedy)
       case '*':
@@ -54,14 +74,14 @@ std::basic_string<T> NextToken(StrConstIt<T> &begin, StrConstIt<T> &end) {
       case '?':
         if (++begin != end) {
           if (*begin == '?') {
-            return basic_string<T>(cur_begin, ++begin);
+            return token(++begin);
           }
         }
-        return basic_string<T>(cur_begin, begin);
+        return token(begin);
 
       case '\\':  // escape characters
         begin = SkipEscapeCharacters<T>(begin, end);
-        return basic_string<T>(cur_begin, begin);
+        return token(begin);
 
         // See [...] {...} <...> as a lex. Although it cannot be nested,
         // nested error is detected by caller and now we only find the first
@@ -71,15 +91,11 @@ std::basic_string<T> NextToken(StrConstIt<T> &begin, StrConstIt<T> &end) {
         while (++begin != end) {
           // skip \] \}
           begin = SkipEscapeCharacters<T>(begin, end);
-          if (begin != end) {
-            auto it = pair_characters.find(*begin);
-            if (it != pair_characters.end() &&
-                it->second == *cur_begin) {
-              return basic_string<T>(cur_begin, ++begin);
-            }
+          if (begin != end && *begin == GetRightBracket(*cur_begin)) {
+            return token(++begin);
           }
         }
-        return basic_string<T>();  // lack of ] } >
+        return {};  // lack of ] } >
 
         // () and contents between them are seen as one token and it can be
         // nested.
@@ -98,20 +114,20 @@ std::basic_string<T> NextToken(StrConstIt<T> &begin, StrConstIt<T> &end) {
           }
         }
         if (parentheses == 0) {
-          return basic_string<T>(cur_begin, ++begin);
+          return token(++begin);
         }
-        return basic_string<T>();  // lack of )
+        return {};  // lack of )
 
         // lack of their left pairs
       case ']':
       case '}':
       case ')':
-        return basic_string<T>();
+        return {};
       default:
-        return basic_string<T>(1, *begin++);
+        return token(++begin);
     }
   }
-  return basic_string<T>();  // All characters in regex have been scanned.
+  return {};  // All characters in regex have been scanned.
 }
 
 template<class T>
@@ -130,14 +146,21 @@ StrConstIt<T> SkipEscapeCharacters(StrConstIt<T> begin, StrConstIt<T> end) {
     if (cur_it != begin + 1) {
       return cur_it;
     }
+    if (cur_it == end) {  // \ at the end
+      return begin;
+    }
 
+    // A truncated escape ends at the end of the regex.
+    auto skip = [&cur_it, &end](int length) {
+      return cur_it + min<ptrdiff_t>(length, end - cur_it);
+    };
     switch (*cur_it) {
       case 'u':
-        return cur_it + 5;
+        return skip(5);
       case 'c':
-        return cur_it + 2;
+        return skip(2);
       case 'x':
-        return cur_it + 3;
+        return skip(3);
       case '\0':
         return begin;
       default:
@@ -0,0 +1,189 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#ifndef XYREGENGINE_LEXER_H
+#define XYREGENGINE_LEXER_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "dfa.h"
+#include "lex.h"
+#include "nfa.h"
+
+namespace XyRegEngine {
+/**
+ * A token produced by Lexer<T>.
+ */
+template<class T>
+struct Token {
+  int id;  // token id of the matched rule
+  SubMatch<T> lexeme;
+};
+
+/**
+ * A tokenizer generated from an ordered list of rules. Every rule is a
+ * regex with a token id. All rules are compiled into a single minimized
+ * DFA by NfaFactory<T>::MakeSetNfa, whose accept states hold the rules they
+ * accept. A token is the longest non-empty match at the current location
+ * (maximal munch), and when several rules match it the earliest rule wins,
+ * which is resolved in the accept states. So every character costs a
+ * single transition however many rules there are.
+ *
+ * A DFA can't handle rules that are invalid or contain assertions,
+ * back-references or repetitions too large to be unrolled. Such rules are
+ * reported by GetRejectedRules, and the lexer is empty if there are any,
+ * since tokens found without them would be wrong.
+ */
+template<class T>
+class Lexer {
+ public:
+  /**
+   * @param rules regexes and their token ids in the order of priority
+   * @param max_states upper bound of DFA states before minimization
+   */
+  explicit Lexer(const std::vector<std::pair<std::basic_string<T>, int>> &rules,
+                 int max_states = Dfa<T>::kDefaultMaxStates);
+
+  /**
+   * @return whether there are no rules, a rule is rejected, or the DFA
+   * needs more than max_states states. Then no token is ever found.
+   */
+  [[nodiscard]] bool Empty() const {
+    return dfa_.Empty();
+  }
+
+  /**
+   * @return indexes of the rules that the DFA can't handle
+   */
+  [[nodiscard]] const std::vector<int> &GetRejectedRules() const {
+    return rejected_rules_;
+  }
+
+  /**
+   * Match a token exactly at begin (sticky mode).
+   *
+   * @param begin
+   * @param end
+   * @param token It is only set when a token is found.
+   * @return whether a token begins at begin
+   */
+  bool NextToken(StrConstIt<T> begin, StrConstIt<T> end,
+                 Token<T> &token) const;
+
+  /**
+   * Find the first token in the range of [begin, end). Characters before
+   * it are skipped. All locations are tried in a single pass of the DFA.
+   *
+   * @param begin
+   * @param end
+   * @param token It is only set when a token is found.
+   * @return whether a token is found
+   */
+  bool SearchToken(StrConstIt<T> begin, StrConstIt<T> end,
+                   Token<T> &token) const {
+    MatchScratch<T> scratch;
+    return SearchToken(begin, end, token, scratch);
+  }
+
+  /**
+   * The same as SearchToken(begin, end, token), but threads of the DFA are
+   * kept in scratch.
+   */
+  bool SearchToken(StrConstIt<T> begin, StrConstIt<T> end, Token<T> &token,
+                   MatchScratch<T> &scratch) const;
+
+  /**
+   * Split s into tokens. In sticky mode every token begins where the last
+   * one ends, and it stops at the first location where no token matches.
+   * Otherwise characters that begin no token are skipped.
+   *
+   * @param s It should outlive the tokens.
+   * @param tokens found tokens are appended to it
+   * @param is_sticky
+   * @return whether the whole s is split into tokens in sticky mode. It is
+   * always true otherwise.
+   */
+  bool Tokenize(const std::basic_string<T> &s, std::vector<Token<T>> &tokens,
+                bool is_sticky = true) const;
+
+  bool Tokenize(const std::basic_string<T> &&s, std::vector<Token<T>> &tokens,
+                bool is_sticky = true) const = delete;
+
+ private:
+  // token id of every rule
+  std::vector<int> token_ids_;
+  std::vector<int> rejected_rules_;
+  // Tags of its accept states are indexes of rules.
+  Dfa<T> dfa_;
+};
+
+template<class T>
+Lexer<T>::Lexer(const std::vector<std::pair<std::basic_string<T>, int>> &rules,
+                int max_states) {
+  using namespace std;
+
+  vector<basic_string<T>> regexes;
+  for (const auto &[regex, token_id]:rules) {
+    regexes.push_back(regex);
+    token_ids_.push_back(token_id);
+  }
+
+  vector<int> accept_states;
+  auto nfa = NfaFactory<T>::MakeSetNfa(regexes, accept_states);
+  for (int i = 0; i < static_cast<int>(accept_states.size()); ++i) {
+    if (accept_states[i] == -1) {
+      rejected_rules_.push_back(i);
+    }
+  }
+  if (!nfa.Empty() && rejected_rules_.empty()) {
+    dfa_ = Dfa<T>(nfa, accept_states, max_states);
+  }
+}
+
+template<class T>
+bool Lexer<T>::NextToken(StrConstIt<T> begin, StrConstIt<T> end,
+                         Token<T> &token) const {
+  StrConstIt<T> match_end;
+  int rule;
+  // The longest match is empty only if no rule matches a non-empty string.
+  if (!dfa_.NextMatch(begin, end, match_end, rule) || match_end == begin) {
+    return false;
+  }
+  token = {token_ids_[rule], {begin, match_end}};
+  return true;
+}
+
+template<class T>
+bool Lexer<T>::SearchToken(StrConstIt<T> begin, StrConstIt<T> end,
+                           Token<T> &token, MatchScratch<T> &scratch) const {
+  SubMatch<T> lexeme;
+  int rule;
+  if (!dfa_.Search(begin, end, lexeme, rule, scratch)) {
+    return false;
+  }
+  token = {token_ids_[rule], lexeme};
+  return true;
+}
+
+template<class T>
+bool Lexer<T>::Tokenize(const std::basic_string<T> &s,
+                        std::vector<Token<T>> &tokens, bool is_sticky) const {
+  Token<T> token;
+  MatchScratch<T> scratch;
+  auto cur = s.cbegin();
+  while (cur != s.cend()) {
+    if (is_sticky ? !NextToken(cur, s.cend(), token)
+                  : !SearchToken(cur, s.cend(), token, scratch)) {
+      return !is_sticky;
+    }
+    tokens.push_back(token);
+    cur = token.lexeme.second;
+  }
+  return true;
+}
+}
+
+#endif //XYREGENGINE_LEXER_H
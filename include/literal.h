@@ -0,0 +1,583 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#ifndef XYREGENGINE_LITERAL_H
+#define XYREGENGINE_LITERAL_H
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <memory_resource>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "nfa.h"
+
+namespace XyRegEngine {
+/**
+ * Literal strings of a sub-expression.
+ */
+template<class T>
+struct Literals {
+  std::set<std::basic_string<T>> strings;
+  // If it is true, the sub-expression matches exactly the strings, leaving
+  // assertions aside. Otherwise every match of it only begins with one of
+  // the strings.
+  bool is_exact{true};
+};
+
+/**
+ * Analyses the AST built by Nfa<T>::ParseRegex to find literal strings that
+ * every match must contain. Literal sets are kept small, so when a
+ * concatenation makes too many strings they are cut to shorter ones and
+ * become inexact. Alternations of literals may be much larger, since they
+ * are handled by an Aho-Corasick automaton.
+ */
+template<class T>
+class LiteralExtractor {
+ public:
+  // Ranks of bytes from the rarest(0) to the most common(255) in a mix of
+  // prose and source code. Characters out of a byte rank 0.
+  static constexpr std::array<unsigned char, 256> kByteRanks{
+          162, 150, 151,  18, 152,  10,   0,  30,
+          149, 185, 240,   6,   8,  96,   1,  53,
+          148,  43,  19,  73,  21,   2,   3,  16,
+            5,  12,  20,   9,   4,  11,  14,  61,
+          255, 164, 212, 201, 161, 163, 168, 204,
+          222, 223, 209, 166, 224, 213, 235, 250,
+          229, 227, 211, 203, 198, 194, 188, 184,
+          186, 191, 216, 187, 217, 202, 220, 160,
+          183, 206, 199, 219, 196, 228, 200, 195,
+          178, 221, 175, 177, 218, 193, 214, 208,
+          205, 165, 207, 231, 215, 189, 174, 171,
+          197, 172, 173, 182, 176, 181, 154, 242,
+          180, 248, 239, 243, 241, 254, 234, 233,
+          236, 251, 190, 225, 247, 238, 244, 249,
+          246, 192, 245, 252, 253, 237, 226, 210,
+          230, 232, 179, 170, 167, 169, 158,  68,
+          157, 134, 123, 105, 112,  48,  79, 129,
+          127,  88,  62,  69,  94,  71,  64, 135,
+           85, 116,  82,  92, 145, 101, 139,  91,
+           95, 130, 104,  90, 131, 114,  87, 153,
+          133, 109,  72, 106, 128,  84,  83, 100,
+           66, 141,  74, 132,  80, 124, 102,  98,
+           86, 143, 110, 125, 107, 117, 136, 111,
+          146, 126, 115, 108, 122, 118, 121, 120,
+           41,   7, 140, 159,  47, 113,  26,  25,
+           13,  17,  23,  34,  37,  29, 142, 119,
+          155, 138,  33,  24,  15,  28,  93, 137,
+           75,  89,  39,  52,  27,  49,  38,  56,
+          144,  76, 156,  97,  35,  70,  65,  63,
+           44,  59,  36,  67,  50,  57,  54, 103,
+          147,  31,  32,  55,  22,  45,  46,  78,
+           60,  40,  42,  77,  58,  51,  81,  99};
+
+  // the most literals a concatenation may produce
+  static constexpr int kMaxLiterals = 32;
+  // the most literals an alternation may produce
+  static constexpr int kMaxAlternatives = 1 << 16;
+  static constexpr int kMaxLiteralLength = 16;
+  // A range is only expanded to literals when it is small enough.
+  static constexpr int kMaxRangeCharacters = 4;
+
+  /**
+   * @param regex
+   * @return Strings that every match of regex begins with. It is empty if
+   * regex is invalid or no useful prefix exists, e.g. regex may match the
+   * empty string.
+   */
+  static std::set<std::basic_string<T>>
+  ExtractPrefixes(const std::basic_string<T> &regex);
+
+  /**
+   * Find the most selective set of literals that every match of regex
+   * contains. The regex is split into a sequence of concatenated
+   * sub-expressions and every suffix of the sequence is tried, so the
+   * literals are prefixes of a suffix. Longer literals are preferred.
+   *
+   * @param regex
+   * @param max_offset The largest distance from the beginning of a match to
+   * the literal it contains. It is INT_MAX if there is no bound.
+   * @return It is empty if regex is invalid or no useful literal exists.
+   */
+  static std::set<std::basic_string<T>>
+  ExtractRequired(const std::basic_string<T> &regex, int &max_offset);
+
+  /**
+   * @param regex
+   * @return All strings that regex matches, e.g. error|fatal|panic. It is
+   * empty if regex is invalid or isn't a set of non-empty literals.
+   * Assertions are ignored, so the caller should check that there are none.
+   */
+  static std::set<std::basic_string<T>>
+  ExtractExact(const std::basic_string<T> &regex);
+
+  /**
+   * @param regex
+   * @param literal the only string regex matches. It is only set when regex
+   * is a plain string.
+   * @return whether regex is a concatenation of single characters, e.g.
+   * user\[id\]. Unlike ExtractExact, the string may be of any length.
+   */
+  static bool ExtractString(const std::basic_string<T> &regex,
+                            std::basic_string<T> &literal);
+
+ private:
+  /**
+   * @param ast_head
+   * @return literals that every match of the AST begins with
+   */
+  static Literals<T> Prefixes(const AstNode<T> *ast_head);
+
+  /**
+   * @param ast_head
+   * @param literal characters of the AST are appended to it
+   * @return whether the AST is a concatenation of single characters
+   */
+  static bool AppendString(const AstNode<T> *ast_head,
+                           std::basic_string<T> &literal);
+
+  /**
+   * @param ast_head
+   * @return the longest length of a match of the AST, or INT_MAX if it has
+   * no bound
+   */
+  static int MaxLength(const AstNode<T> *ast_head);
+
+  /**
+   * Split the AST into sub-expressions concatenated in order. Groups are
+   * split as well.
+   *
+   * @param ast_head
+   * @param sequence
+   */
+  static void Split(const AstNode<T> *ast_head,
+                    std::vector<const AstNode<T> *> &sequence);
+
+  /**
+   * @param left
+   * @param right
+   * @return literals that every match of left followed by right begins with
+   */
+  static Literals<T> Concat(const Literals<T> &left, const Literals<T> &right);
+
+  /**
+   * @param characters a character, a special pattern or a range
+   * @param literals all characters matched by 'characters'
+   * @return false if 'characters' matches too many characters
+   */
+  static bool ToCharacters(std::basic_string_view<T> characters,
+                           std::basic_string<T> &literals);
+
+  /**
+   * @param strings
+   * @return how often the strings are expected to occur in common text.
+   * A string is as rare as its rarest character, and the set occurs as
+   * often as its most common string, since a candidate is found at every
+   * string.
+   */
+  static int Frequency(const std::set<std::basic_string<T>> &strings);
+
+  /**
+   * @param ast_head
+   * @return whether the AST repeats a sub-expression, e.g. a+. Literals of
+   * a repetition come in runs, so a filter stops at nearly every character
+   * of a run.
+   */
+  static bool IsRepetition(const AstNode<T> *ast_head) {
+    return ast_head->regex_type_ == RegexPart::kQuantifier &&
+           ast_head->repeat_range_.second > 1;
+  }
+
+  /**
+   * @return the prefix of everything, which is useless as a filter
+   */
+  static Literals<T> Anything() {
+    return {{std::basic_string<T>()}, false};
+  }
+};
+
+template<class T>
+std::set<std::basic_string<T>>
+LiteralExtractor<T>::ExtractPrefixes(const std::basic_string<T> &regex) {
+  using namespace std;
+
+  pmr::monotonic_buffer_resource arena;
+  auto ast_head = Nfa<T>::ParseRegex(regex, &arena);
+  if (!ast_head) {
+    return {};
+  }
+
+  auto prefixes = Prefixes(ast_head.get());
+  if (prefixes.strings.contains(basic_string<T>())) {
+    return {};
+  }
+  return prefixes.strings;
+}
+
+template<class T>
+std::set<std::basic_string<T>>
+LiteralExtractor<T>::ExtractRequired(const std::basic_string<T> &regex,
+                                     int &max_offset) {
+  using namespace std;
+
+  pmr::monotonic_buffer_resource arena;
+  auto ast_head = Nfa<T>::ParseRegex(regex, &arena);
+  if (!ast_head) {
+    return {};
+  }
+  vector<const AstNode<T> *> sequence;
+  Split(ast_head.get(), sequence);
+
+  // offsets[i] -- the longest length of sequence[0, i)
+  vector<int> offsets{0};
+  for (auto node:sequence) {
+    int length = MaxLength(node);
+    offsets.push_back(length == INT_MAX || offsets.back() > INT_MAX - length
+                      ? INT_MAX : offsets.back() + length);
+  }
+
+  // Literals of a suffix are the prefixes of its first sub-expression
+  // followed by those of the next suffix. Literals ending inside a
+  // repetition, e.g. those of (?:ab){300}c, occur at nearly every character
+  // of a run however long they are, so they lose to all others. Then longer
+  // literals win, then those out of repetitions, then rarer ones.
+  set<basic_string<T>> required;
+  tuple<bool, size_t, bool, int> required_rank;
+  auto min_size = [](const set<basic_string<T>> &strings) {
+    size_t size = SIZE_MAX;
+    for (const auto &s:strings) {
+      size = min(size, s.size());
+    }
+    return size;
+  };
+  Literals<T> suffix{{basic_string<T>()}, true};
+  for (int i = static_cast<int>(sequence.size()) - 1; i >= 0; --i) {
+    auto prefixes = Prefixes(sequence[i]);
+    suffix = Concat(prefixes, suffix);
+    if (suffix.strings.contains(basic_string<T>())) {
+      continue;
+    }
+    bool is_repetition = IsRepetition(sequence[i]);
+    tuple<bool, size_t, bool, int> rank{!is_repetition || prefixes.is_exact,
+                                        min_size(suffix.strings),
+                                        !is_repetition,
+                                        -Frequency(suffix.strings)};
+    // Earlier suffixes win a tie since their offsets are smaller.
+    if (required.empty() || rank >= required_rank) {
+      required = suffix.strings;
+      required_rank = rank;
+      max_offset = offsets[i];
+    }
+  }
+  return required;
+}
+
+template<class T>
+std::set<std::basic_string<T>>
+LiteralExtractor<T>::ExtractExact(const std::basic_string<T> &regex) {
+  using namespace std;
+
+  pmr::monotonic_buffer_resource arena;
+  auto ast_head = Nfa<T>::ParseRegex(regex, &arena);
+  if (!ast_head) {
+    return {};
+  }
+
+  auto literals = Prefixes(ast_head.get());
+  if (!literals.is_exact || literals.strings.contains(basic_string<T>())) {
+    return {};
+  }
+  return literals.strings;
+}
+
+template<class T>
+bool LiteralExtractor<T>::ExtractString(const std::basic_string<T> &regex,
+                                        std::basic_string<T> &literal) {
+  using namespace std;
+
+  pmr::monotonic_buffer_resource arena;
+  auto ast_head = Nfa<T>::ParseRegex(regex, &arena);
+  basic_string<T> characters;
+  if (!ast_head || !AppendString(ast_head.get(), characters)) {
+    return false;
+  }
+  literal = std::move(characters);
+  return true;
+}
+
+template<class T>
+Literals<T> LiteralExtractor<T>::Prefixes(const AstNode<T> *ast_head) {
+  using namespace std;
+
+  if (!ast_head) {
+    return {{basic_string<T>()}, true};
+  }
+
+  switch (ast_head->regex_type_) {
+    case RegexPart::kChar: {
+      basic_string<T> characters;
+      if (!ToCharacters(ast_head->regex_, characters)) {
+        return Anything();
+      }
+      Literals<T> literals;
+      for (auto c:characters) {
+        literals.strings.insert(basic_string<T>(1, c));
+      }
+      return literals;
+    }
+    case RegexPart::kAlternative: {
+      auto literals = Prefixes(ast_head->left_son_.get());
+      auto right = Prefixes(ast_head->right_son_.get());
+      // A long alternation is a deep tree, so the smaller set is merged
+      // into the larger one.
+      if (literals.strings.size() < right.strings.size()) {
+        swap(literals.strings, right.strings);
+      }
+      literals.strings.merge(right.strings);
+      literals.is_exact = literals.is_exact && right.is_exact;
+      if (literals.strings.size() > kMaxAlternatives) {
+        return Anything();
+      }
+      return literals;
+    }
+    case RegexPart::kAnd:
+      return Concat(Prefixes(ast_head->left_son_.get()),
+                    Prefixes(ast_head->right_son_.get()));
+    case RegexPart::kQuantifier: {
+      auto repeat_range = ast_head->repeat_range_;
+      auto son = Prefixes(ast_head->left_son_.get());
+
+      // x{m,n} begins with x{m}
+      Literals<T> literals{{basic_string<T>()}, true};
+      for (int i = 0; i < repeat_range.first && literals.is_exact; ++i) {
+        literals = Concat(literals, son);
+      }
+      if (repeat_range.first == repeat_range.second) {
+        return literals;
+      }
+      if (repeat_range.first == 0 && repeat_range.second == 1) {  // x?
+        son.strings.insert(basic_string<T>());
+        return son;
+      }
+      literals.is_exact = false;
+      return literals;
+    }
+    case RegexPart::kGroup:
+      return Prefixes(ast_head->left_son_.get());
+    case RegexPart::kAssertion:
+      // Assertions don't consume characters.
+      return {{basic_string<T>()}, true};
+    default:
+      return Anything();
+  }
+}
+
+template<class T>
+int LiteralExtractor<T>::Frequency(
+        const std::set<std::basic_string<T>> &strings) {
+  int frequency = 0;
+  for (const auto &s:strings) {
+    int rarest = INT_MAX;
+    for (auto c:s) {
+      auto code_point = CodePoint(c);
+      rarest = std::min(rarest, code_point < kByteRanks.size()
+                                ? kByteRanks[code_point] : 0);
+    }
+    frequency = std::max(frequency, rarest);
+  }
+  return frequency;
+}
+
+template<class T>
+bool LiteralExtractor<T>::AppendString(const AstNode<T> *ast_head,
+                                       std::basic_string<T> &literal) {
+  using namespace std;
+
+  if (!ast_head) {
+    return false;
+  }
+  if (ast_head->regex_type_ == RegexPart::kAnd) {
+    return AppendString(ast_head->left_son_.get(), literal) &&
+           AppendString(ast_head->right_son_.get(), literal);
+  }
+  basic_string<T> characters;
+  if (ast_head->regex_type_ != RegexPart::kChar ||
+      !ToCharacters(ast_head->regex_, characters) || characters.size() != 1) {
+    return false;
+  }
+  literal += characters;
+  return true;
+}
+
+template<class T>
+int LiteralExtractor<T>::MaxLength(const AstNode<T> *ast_head) {
+  using namespace std;
+
+  if (!ast_head) {
+    return 0;
+  }
+
+  switch (ast_head->regex_type_) {
+    case RegexPart::kChar:
+      // Only a back-reference may match several characters.
+      if (ast_head->regex_[0] == kReverseSolidus) {
+        return SpecialPatternNfa<T>(basic_string<T>(ast_head->regex_))
+                       .IsBackReference()
+               ? INT_MAX : 1;
+      }
+      if (ast_head->regex_[0] == '[') {
+        for (const auto &special_pattern:
+                RangeNfa<T>(basic_string<T>(ast_head->regex_))
+                        .special_patterns_) {
+          if (special_pattern.IsBackReference()) {
+            return INT_MAX;
+          }
+        }
+      }
+      return 1;
+    case RegexPart::kAlternative:
+      return max(MaxLength(ast_head->left_son_.get()),
+                 MaxLength(ast_head->right_son_.get()));
+    case RegexPart::kAnd: {
+      int left = MaxLength(ast_head->left_son_.get());
+      int right = MaxLength(ast_head->right_son_.get());
+      return left == INT_MAX || right == INT_MAX || left > INT_MAX - right
+             ? INT_MAX : left + right;
+    }
+    case RegexPart::kQuantifier: {
+      auto repeat_range = ast_head->repeat_range_;
+      int son = MaxLength(ast_head->left_son_.get());
+      if (son == 0) {
+        return 0;
+      }
+      return son == INT_MAX || repeat_range.second > INT_MAX / son
+             ? INT_MAX : son * repeat_range.second;
+    }
+    case RegexPart::kGroup:
+      return MaxLength(ast_head->left_son_.get());
+    case RegexPart::kAssertion:
+      return 0;
+    default:
+      return INT_MAX;
+  }
+}
+
+template<class T>
+void LiteralExtractor<T>::Split(const AstNode<T> *ast_head,
+                                std::vector<const AstNode<T> *> &sequence) {
+  if (ast_head->regex_type_ == RegexPart::kAnd) {
+    Split(ast_head->left_son_.get(), sequence);
+    Split(ast_head->right_son_.get(), sequence);
+    return;
+  }
+  if (ast_head->regex_type_ == RegexPart::kGroup) {
+    Split(ast_head->left_son_.get(), sequence);
+    return;
+  }
+  sequence.push_back(ast_head);
+}
+
+template<class T>
+Literals<T> LiteralExtractor<T>::Concat(const Literals<T> &left,
+                                        const Literals<T> &right) {
+  using namespace std;
+
+  if (!left.is_exact) {
+    return left;
+  }
+  // Appending a single string never makes more literals.
+  if (left.strings.size() * right.strings.size() >
+      max<size_t>({kMaxLiterals, left.strings.size(), right.strings.size()})) {
+    return {left.strings, false};
+  }
+
+  Literals<T> literals{{}, right.is_exact};
+  for (const auto &left_string:left.strings) {
+    for (const auto &right_string:right.strings) {
+      auto s = left_string + right_string;
+      if (s.size() > kMaxLiteralLength) {
+        s.resize(kMaxLiteralLength);
+        literals.is_exact = false;
+      }
+      literals.strings.insert(s);
+    }
+  }
+  return literals;
+}
+
+template<class T>
+bool LiteralExtractor<T>::ToCharacters(std::basic_string_view<T> characters,
+                                       std::basic_string<T> &literals) {
+  using namespace std;
+
+  if (characters.size() == 1) {
+    // Nfa sees '\0' as an empty edge.
+    if (characters[0] == kFullStop || characters[0] == '\0') {
+      return false;
+    }
+    literals.push_back(characters[0]);
+    return true;
+  }
+
+  if (characters[0] == kReverseSolidus) {
+    if (characters.size() != 2) {
+      return false;
+    }
+    switch (characters[1]) {
+      case 'd':
+      case 'D':
+      case 's':
+      case 'S':
+      case 'w':
+      case 'W':
+        return false;
+      case 't':
+        literals.push_back(kHorizontalTab);
+        return true;
+      case 'n':
+        literals.push_back(kLineFeed);
+        return true;
+      case 'v':
+        literals.push_back(kVerticalTab);
+        return true;
+      case 'f':
+        literals.push_back(kFormFeed);
+        return true;
+      case '0':
+        literals.push_back(kNull);
+        return true;
+      default:
+        if (characters[1] >= '1' && characters[1] <= '9') {  // back reference
+          return false;
+        }
+        literals.push_back(characters[1]);
+        return true;
+    }
+  }
+
+  // [...]
+  RangeNfa<T> range_nfa{basic_string<T>(characters)};
+  if (range_nfa.except_ || !range_nfa.special_patterns_.empty()) {
+    return false;
+  }
+  for (const auto &range:range_nfa.ranges_) {
+    if (range.first > range.second ||
+        range.second - range.first >= kMaxRangeCharacters) {
+      return false;
+    }
+    for (auto c = range.first; c <= range.second; ++c) {
+      literals.push_back(static_cast<T>(c));
+    }
+    if (literals.size() > kMaxRangeCharacters) {
+      return false;
+    }
+  }
+  return !literals.empty();
+}
+}
+
+#endif //XYREGENGINE_LITERAL_H
@@ -0,0 +1,143 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#ifndef XYREGENGINE_LITERAL_SEARCHER_H
+#define XYREGENGINE_LITERAL_SEARCHER_H
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <utility>
+
+#include "char_class.h"
+#include "lex.h"
+#include "prefilter.h"
+
+namespace XyRegEngine {
+/**
+ * Search for a single literal string without any automaton.
+ *
+ * It is a Boyer-Moore-Horspool search: the last character of a window
+ * decides how far the window can move, so most characters of the text are
+ * never looked at when the literal is long. Shifts are kept for the low
+ * byte of every character. Characters sharing a low byte get the smallest
+ * of their shifts, which is always safe, so wide characters work with the
+ * same table.
+ *
+ * For char with SSE2, comparing the first and the last characters of 16
+ * windows at once in Prefilter is faster than moving one window at a time
+ * for literals of usual lengths, so it is used instead.
+ */
+template<class T>
+class LiteralSearcher {
+ public:
+  static constexpr unsigned int kTableSize = 256;
+
+  /**
+   * @param literal It should not be empty.
+   */
+  explicit LiteralSearcher(std::basic_string<T> literal);
+
+  /**
+   * @param begin
+   * @param end
+   * @param match_end It is only set when the literal begins at begin.
+   * @return whether the literal begins at begin
+   */
+  bool NextMatch(StrConstIt<T> begin, StrConstIt<T> end,
+                 StrConstIt<T> &match_end) const;
+
+  /**
+   * Find the first occurrence of the literal in the range of [begin, end).
+   *
+   * @param begin
+   * @param end
+   * @param match It is only set when the literal is found.
+   * @return whether the literal is found
+   */
+  bool Search(StrConstIt<T> begin, StrConstIt<T> end,
+              std::pair<StrConstIt<T>, StrConstIt<T>> &match) const;
+
+ private:
+  /**
+   * @return the first location in [begin, end) where the literal begins,
+   * or end if there is none
+   */
+  [[nodiscard]] StrConstIt<T> Find(StrConstIt<T> begin,
+                                   StrConstIt<T> end) const;
+
+  std::basic_string<T> literal_;
+  // It only holds literal_.
+  Prefilter<T> prefilter_;
+  // shifts_[low byte of c] -- distance to move the window when c is its
+  // last character
+  std::array<int, kTableSize> shifts_{};
+};
+
+template<class T>
+LiteralSearcher<T>::LiteralSearcher(std::basic_string<T> literal)
+        : literal_(std::move(literal)), prefilter_({literal_}) {
+  int size = literal_.size();
+  shifts_.fill(size);
+  for (int i = 0; i < size - 1; ++i) {
+    shifts_[CodePoint(literal_[i]) % kTableSize] = size - 1 - i;
+  }
+}
+
+template<class T>
+bool LiteralSearcher<T>::NextMatch(StrConstIt<T> begin, StrConstIt<T> end,
+                                   StrConstIt<T> &match_end) const {
+  if (static_cast<std::size_t>(end - begin) < literal_.size() ||
+      !std::equal(literal_.cbegin(), literal_.cend(), begin)) {
+    return false;
+  }
+  match_end = begin + literal_.size();
+  return true;
+}
+
+template<class T>
+bool LiteralSearcher<T>::Search(
+        StrConstIt<T> begin, StrConstIt<T> end,
+        std::pair<StrConstIt<T>, StrConstIt<T>> &match) const {
+  auto literal = Find(begin, end);
+  if (literal == end) {
+    return false;
+  }
+  match = {literal, literal + literal_.size()};
+  return true;
+}
+
+template<class T>
+StrConstIt<T> LiteralSearcher<T>::Find(StrConstIt<T> begin,
+                                       StrConstIt<T> end) const {
+  using namespace std;
+
+  int size = literal_.size();
+  if (end - begin < size) {
+    return end;
+  }
+  if (size == 1) {
+    auto it = char_traits<T>::find(&*begin, end - begin, literal_[0]);
+    return it == nullptr ? end : begin + (it - &*begin);
+  }
+
+#if defined(__SSE2__)
+  if constexpr (sizeof(T) == 1) {
+    return prefilter_.FindLiteral(begin, end);
+  }
+#endif
+
+  auto last = literal_.back();
+  for (auto cur = begin; end - cur >= size;) {
+    auto c = cur[size - 1];
+    if (c == last && equal(literal_.cbegin(), literal_.cend() - 1, cur)) {
+      return cur;
+    }
+    cur += shifts_[CodePoint(c) % kTableSize];
+  }
+  return end;
+}
+}
+
+#endif //XYREGENGINE_LITERAL_SEARCHER_H
@@ -5,15 +5,24 @@
 #ifndef XYREGENGINE_NFA_H
 #define XYREGENGINE_NFA_H
 
+#include <algorithm>
 #include <climits>
+#include <iterator>
 #include <map>
 #include <memory>
+#include <memory_resource>
+#include <span>
 #include <stack>
 #include <set>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "char_class.h"
+#include "dfa_cache.h"
 #include "lex.h"
+#include "prefilter.h"
+#include "sparse_set.h"
 
 namespace XyRegEngine {
 template<class T>
@@ -25,9 +34,6 @@ class NfaFactory;
 template<class T>
 class AssertionNfa;
 
-template<class T>
-class GroupNfa;
-
 template<class T>
 class SpecialPatternNfa;
 
@@ -35,14 +41,45 @@ template<class T>
 class RangeNfa;
 
 template<class T>
-using AstNodePtr = std::unique_ptr<AstNode<T>>;
+class ClassNfa;
+
+template<class T>
+class GlushkovNfa;
+
+template<class T>
+class LazyDfa;
+
+template<class T>
+class LiteralExtractor;
+
+template<class T>
+class Regex;
+
+template<class T>
+class MatchScratch;
+
+/**
+ * AST nodes are allocated from a memory resource, which is usually a
+ * monotonic arena owned by a compilation. Deleting a node destroys it and
+ * gives its memory back to the resource, which is a no-op for an arena, so
+ * all nodes of a compilation are released at once with the arena.
+ */
+template<class T>
+struct AstNodeDeleter {
+  std::pmr::memory_resource *resource{nullptr};
+
+  void operator()(AstNode<T> *node) const;
+};
+
+template<class T>
+using AstNodePtr = std::unique_ptr<AstNode<T>, AstNodeDeleter<T>>;
 // a sub-match [pair.first, pair.second)
 template<class T> using SubMatch = std::pair<StrConstIt<T>, StrConstIt<T>>;
-// pair.first -- state
-// pair.second -- current begin iterator
-// map.second -- Sub-matches. Every vector<SubMatch> stores a possible
-// sub-match order.
-template<class T> using ReachableStatesMap = std::map<std::pair<int, StrConstIt<T>>, std::vector<SubMatch<T>>>;
+// A match returned by a NFA.
+// pair.first.first -- state
+// pair.first.second -- end of the match
+// pair.second -- Sub-matches. It always has a slot for every group in the
+// regex and an unmatched group is [str_end, str_end).
 template<class T> using State = std::pair<std::pair<int, StrConstIt<T>>, std::vector<SubMatch<T>>>;
 template<class T> using StatePtr = std::unique_ptr<State<T>>;
 
@@ -72,6 +109,16 @@ class Nfa {
 
   friend class AssertionNfa<T>;
 
+  friend class ClassNfa<T>;
+
+  friend class GlushkovNfa<T>;
+
+  friend class LiteralExtractor<T>;
+
+  friend class Regex<T>;
+
+  friend class MatchScratch<T>;
+
  public:
   /**
    * Build a NFA for 'regex'. Notice that if 'regex' is invalid, it
@@ -94,22 +141,141 @@ class Nfa {
   /**
    * Get the next match in a given string in the range of [begin, end).
    * Notice that it matches from begin, say, the successful match must
-   * be [begin, any location no more than end).
+   * be [begin, any location no more than end). The longest match is
+   * returned.
    *
-   * @param begin First iterator of the given string. If we successfully
-   * find a token, 'begin' will be moved to the beginning of the first
-   * character after the match.
+   * @param begin First iterator of the given string.
    * @param end Last iterator of the given string.
-   * @return A matched substring. If no match exists, it returns "".
+   * @return The accept state of the longest match. state.first.second is
+   * the end of the match and state.second stores sub-matches of all groups
+   * in order. If no match exists or the NFA is empty, it returns nullptr.
+   */
+  StatePtr<T> NextMatch(StrConstIt<T> begin, StrConstIt<T> end) const;
+
+  /**
+   * The same as NextMatch(begin, end), but buffers of the run are taken
+   * from scratch, so it doesn't allocate once scratch is warmed up.
+   *
+   * @param begin
+   * @param end
+   * @param scratch
+   * @return The accept state of the longest match, which is stored in
+   * scratch and valid until scratch is used again. If no match exists or
+   * the NFA is empty, it returns nullptr.
    */
-  StatePtr<T> NextMatch(StrConstIt<T> begin, StrConstIt<T> end);
+  const State<T> *NextMatch(StrConstIt<T> begin, StrConstIt<T> end,
+                            MatchScratch<T> &scratch) const;
+
+  /**
+   * Find the leftmost match in the range of [begin, end). If several
+   * matches begin at the same location, the longest one is chosen. Notice
+   * that a match never begins at end.
+   *
+   * It is done in a single pass with a thread added at every location.
+   * When the regex has back-references, threads with different beginnings
+   * can't be merged since sub-matches decide how they go on, so every
+   * beginning has its own thread lists, as if NextMatch ran at every
+   * location at the same time. A relaxed run of RunThreads finds the
+   * leftmost location where a match may begin first, and nothing before it
+   * is run.
+   *
+   * @param begin
+   * @param end
+   * @param match_begin beginning of the match. It is only set when a match
+   * exists.
+   * @param prefilter If it isn't nullptr, locations out of its candidates
+   * are skipped when no thread is alive. It should hold literals of the
+   * regex.
+   * @return The same as NextMatch(match_begin, end). If no match exists or
+   * the NFA is empty, it returns nullptr.
+   */
+  StatePtr<T> Search(StrConstIt<T> begin, StrConstIt<T> end,
+                     StrConstIt<T> &match_begin,
+                     const Prefilter<T> *prefilter = nullptr) const;
+
+  /**
+   * The same as Search(begin, end, match_begin, prefilter), but buffers of
+   * the run are taken from scratch.
+   *
+   * @return The same as NextMatch(begin, end, scratch).
+   */
+  const State<T> *Search(StrConstIt<T> begin, StrConstIt<T> end,
+                         StrConstIt<T> &match_begin, MatchScratch<T> &scratch,
+                         const Prefilter<T> *prefilter = nullptr) const;
+
+  /**
+   * @return number of groups in the regex
+   */
+  [[nodiscard]] int GetGroupNum() const {
+    return group_num_;
+  }
 
  protected:
   enum class StateType {
-    kAssertion, kGroup, kSpecialPattern, kRange, kCommon
+    kAssertion, kTag, kCounter, kSpecialPattern, kRange, kCommon
   };
 
-  static const int kEmptyEdge = 0;
+  static constexpr int kEmptyEdge = 0;
+
+  // Larger closures are computed when they are used, so closures of a
+  // long chain of empty edges, e.g. a large alternation, take linear
+  // memory.
+  static constexpr int kMaxClosureSize = 64;
+
+  /**
+   * A character edge of a frozen NFA.
+   */
+  struct Edge {
+    int char_range;  // index in char_ranges_
+    int next_state;
+  };
+
+  /**
+   * Kind of a state of a frozen NFA. The payload of a functional state is
+   * element index of the vector for its type, e.g. range_nfas_.
+   */
+  struct StateInfo {
+    StateType type;
+    int index;
+  };
+
+  /**
+   * A tag state records where a group begins or ends in the sub-matches of
+   * a thread. The sub-pattern of a group is built between its two tags, so
+   * groups are captured in the same run as the rest of the regex.
+   */
+  struct Tag {
+    int group;  // index of the group
+    bool is_begin;
+    // Groups nested in the group are [group + 1, group_end). Their slots
+    // are reset where the group begins, so a quantified group only keeps
+    // sub-matches of its last repetition.
+    int group_end;
+  };
+
+  /**
+   * x{n,m} with a large bound is built once between two counter states
+   * instead of being unrolled. A thread counts its repetitions in the
+   * counters of its row. The begin state resets the counter and the end
+   * state either repeats x or leaves the loop.
+   */
+  struct Counter {
+    int index;  // index of the counter in a row
+    bool is_begin;
+    int min;
+    int max;  // INT_MAX if it has no upper bound
+  };
+
+  /**
+   * A thread of a run. Its sub-matches and counters are kept in a row of
+   * the scratch, which is shared by threads forked from it until one of
+   * them writes it.
+   */
+  struct Thread {
+    int state;
+    StrConstIt<T> location;
+    int row;  // -1 if the NFA has no slots and counters
+  };
 
   Nfa() = default;
 
@@ -118,12 +284,26 @@ class Nfa {
    * a nullptr pointer, it creates an empty NFA.
    *
    * @param ast_head can be nullptr
+   * @param char_ranges
+   * @param state_num the same as the one of NewState. All NFAs built in a
+   * compilation share it, so their states never collide.
    */
-  Nfa(AstNodePtr<T> &ast_head, const std::vector<unsigned int> &char_ranges);
+  Nfa(AstNodePtr<T> &ast_head, const std::vector<unsigned int> &char_ranges,
+      int &state_num);
 
   /**
-   * It copies exchange_map_, assertion_states_, not_assertion_states_
-   * and group_states_ to the new NFA.
+   * Build a frozen NFA for a whole regex or the sub-pattern of a
+   * lookahead. Its char ranges are split by the characters of the AST.
+   *
+   * @param ast_head can be nullptr
+   * @param group_num number of sub-match slots. A group in the AST uses
+   * the slot of its index.
+   */
+  Nfa(AstNodePtr<T> &ast_head, int group_num);
+
+  /**
+   * It copies exchange_map_, assertion_states_, tag_states_ and other
+   * functional states to the new NFA.
    *
    * @param nfa After calling the function, nfa.exchange_map_ becomes
    * undefined and should never be accessed again.
@@ -132,42 +312,135 @@ class Nfa {
   Nfa &operator+=(Nfa &nfa);
 
   /**
-   * It tries to move to the next state until to the end of the string or
-   * no next states can be found.
+   * Threads that stay at the same location of the string. Every state is
+   * added at most once for every value of the counters, so the first
+   * thread reaching a state wins.
+   */
+  struct ThreadList {
+    std::vector<Thread> threads;
+    // where every thread begins
+    std::vector<StrConstIt<T>> begins;
+    // States are numbered from 0, so a sparse set records added states. It
+    // is allocated when the first thread is added and cleared in constant
+    // time when the list is reused.
+    SparseSet states;
+    // added states followed by their counters if the NFA has counters
+    TupleSet counted_states;
+
+    void Clear() {
+      threads.clear();
+      begins.clear();
+      states.Clear();
+      counted_states.Clear();
+    }
+  };
+
+  /**
+   * Run all threads from begin_state_ in lock-step like a Pike VM. Threads
+   * are grouped by their locations and the lists are handled in ascending
+   * order of locations. Common states and single character functional
+   * states only add threads to the next location, while back references
+   * may add threads to any later location. Groups are tags recording
+   * sub-matches of a thread and counted repetitions are counters of a
+   * thread, so they never run another NFA. A list is dropped after it is
+   * handled and reused for a later location, so the memory only depends on
+   * the number of states, groups and counters, and a run stops allocating
+   * once its lists are large enough.
+   *
+   * In an unanchored run, a thread is added at every location before end
+   * until a thread is accepted. After that, threads beginning later than
+   * the accepted threads are dropped. Threads in a list are sorted by their
+   * beginnings as long as no back-reference exists, so the earliest thread
+   * wins when several threads reach a state. Otherwise threads of every
+   * beginning have their own lists, and lists at the same location are
+   * handled in ascending order of their beginnings.
+   *
+   * A relaxed run finds where a match of a regex with back-references may
+   * begin in a single pass. A back-reference matches any string there, so
+   * every match of the regex is a match of the relaxed run, and threads
+   * are sorted by their beginnings again. Only the leftmost beginning is
+   * wanted, so threads not beginning before an accepted thread are
+   * dropped.
    *
    * @param begin
    * @param end
-   * @return all possible routines
+   * @param is_unanchored whether to add threads after begin
+   * @param accept Called with every thread reaching accept_state_ and its
+   * beginning. Sub-matches of the thread are valid until the callback
+   * returns. Threads are reported in ascending order of their locations
+   * and at most one thread is reported for a location and a beginning. A
+   * thread beginning later than a reported one is never reported. A thread
+   * is reported when its list is handled since a list may get threads
+   * after a later list is handled.
+   * @param scratch buffers of the run. It may be shared by runs of
+   * different NFAs, but not by nested runs.
+   * @param prefilter It is only used by an unanchored run and can be
+   * nullptr.
+   * @param is_relaxed whether it is a relaxed run
    */
-  std::vector<ReachableStatesMap<T>>
-  StateRoute(StrConstIt<T> begin, StrConstIt<T> end);
+  template<class AcceptCallback>
+  void RunThreads(StrConstIt<T> begin, StrConstIt<T> end, bool is_unanchored,
+                  AcceptCallback accept, MatchScratch<T> &scratch,
+                  const Prefilter<T> *prefilter = nullptr,
+                  bool is_relaxed = false) const;
 
   /**
-   * Get all reachable states starting from cur_state. When cur_state
-   * is a functional state, it will be handled first. For common
-   * states, we match *begin first. Then we deal with states that can
-   * be reached through empty edges.
+   * Add thread and all threads reachable from it through empty edges to
+   * thread_list. Assertions are checked, and tags and counters are
+   * recorded here since they consume nothing. Other functional states are
+   * added to thread_list and handled when the list is stepped. In a relaxed
+   * run, a back-reference is also passed through since it may be empty.
    *
-   * @param cur_state
-   * @param str_begin
+   * @param thread_list list at the location of thread
+   * @param thread It owns a reference to its row, which is passed to the
+   * threads added or released.
+   * @param str_begin where thread begins
    * @param str_end
-   * @return reachable states after handling cur_state
+   * @param scratch scratch of the run. Its stack is empty again when the
+   * function returns.
+   * @param is_relaxed whether it is a relaxed run
+   */
+  void AddThread(ThreadList &thread_list, Thread thread,
+                 StrConstIt<T> str_begin, StrConstIt<T> str_end,
+                 MatchScratch<T> &scratch, bool is_relaxed) const;
+
+  /**
+   * @param thread_list
+   * @param state
+   * @param row row of a thread at state
+   * @param scratch
+   * @return whether state is added to thread_list with the counters of row
    */
-  ReachableStatesMap<T>
-  NextState(const State<T> &cur_state,
-            StrConstIt<T> str_begin, StrConstIt<T> str_end);
+  bool IsMarked(const ThreadList &thread_list, int state, int row,
+                MatchScratch<T> &scratch) const;
 
   /**
-   * All reachable states starting from cur_state through empty edges.
-   * Notice that cur_state is excluded and it does nothing to handle
-   * functional states.
+   * Mark state with the counters of row as added to thread_list.
    *
-   * @param cur_state
-   * @return
+   * @return whether it isn't marked before
    */
-  ReachableStatesMap<T> NextState(const State<T> &cur_state);
+  bool Mark(ThreadList &thread_list, int state, int row,
+            MatchScratch<T> &scratch) const;
 
-  StateType GetStateType(int state);
+  /**
+   * @return whether a special pattern or a range is a back-reference or
+   * contains one. It works both before and after the NFA is frozen.
+   */
+  [[nodiscard]] bool HasBackReference() const;
+
+  /**
+   * @param state a state of a frozen NFA
+   * @return whether state is a back-reference or a range containing one
+   */
+  [[nodiscard]] bool IsBackReference(int state) const;
+
+  /**
+   * @param state a state of a frozen NFA
+   * @return
+   */
+  [[nodiscard]] StateType GetStateType(int state) const {
+    return state_infos_[state].type;
+  }
 
   /**
    * Use 'delim' to split an encoding to several ranges. By default,
@@ -177,50 +450,151 @@ class Nfa {
    * An empty vector means default split mode.
    * @param encoding
    */
-  void CharRangesInit(const std::set<std::basic_string<T>> &delim,
+  void CharRangesInit(const std::set<std::basic_string_view<T>> &delim,
                       Encoding encoding);
 
   /**
-   * Find which character range in the char_ranges_ c is in.
+   * Add characters of an AST to delim. Sub-patterns of lookaheads are
+   * left out since they are built with their own char ranges.
+   *
+   * @param ast_head
+   * @param delim
+   */
+  static void GetDelim(const AstNode<T> *ast_head,
+                       std::set<std::basic_string_view<T>> &delim);
+
+  /**
+   * Find which character range in the char_ranges_ c is in. A frozen NFA
+   * looks it up in char_locations_ instead.
    *
    * @param c must be in the range of the current encoding
    * @return range index in char_ranges_ where c is in
    */
-  int GetCharLocation(int c);
+  int GetCharLocation(int c) const;
 
   /**
-   * Parse a regex to an AST. We assume that regex can only include
-   * several valid elements:
-   * characters(include single character, escape character and '[...]')
-   * quantifiers
-   * |
-   * & (It is implicit in a regex string but we need to explicitly deal
-   * with them when parsing a regex)
-   * groups
-   * assertions
+   * Parse a regex to an AST in a single pass by recursive descent:
    *
-   * All characters should be represented as a node, say, ranges and
-   * escape characters are seen as single character here. Moreover, groups
-   * and lookaheads will add a flag node to the head to remember its type.
+   * alternative := sequence ('|' sequence)*
+   * sequence := (atom quantifier*)+
+   * atom := character | assertion | '(' group ')'
    *
-   * @param regex
+   * Characters(single characters, escape characters and '[...]') and
+   * assertions('^', '$', '\b', '\B') are leaves. Concatenations and
+   * alternatives are left-associative kAnd and kAlternative nodes, and a
+   * quantifier is a kQuantifier node holding its bounds. A group is a
+   * kGroup node and a lookahead is a kAssertion node, and their left sons
+   * are the ASTs of their sub-patterns, so nothing is parsed twice. A
+   * passive group is replaced by the AST of its sub-pattern.
+   *
+   * Groups are numbered in the order of their left parentheses. Groups in
+   * a lookahead are matched by a separate NFA, so they are numbered from 0
+   * in the lookahead and don't count in the regex.
+   *
+   * @param regex Nodes hold views of it, so it should outlive the AST.
+   * @param resource where nodes are allocated. Pass an arena that outlives
+   * the AST to avoid allocating every node on the heap.
+   * @param group_num If it isn't nullptr, it is set to the number of groups
+   * in the regex.
    * @return If regex is in a valid format, return the head of AST.
-   * Otherwise return nullptr.
+   * Otherwise, e.g. a part of it is empty or a quantifier has nothing to
+   * repeat, return nullptr.
    */
-  static AstNodePtr<T> ParseRegex(const std::basic_string<T> &regex);
+  static AstNodePtr<T> ParseRegex(
+          const std::basic_string<T> &regex,
+          std::pmr::memory_resource *resource =
+                  std::pmr::get_default_resource(),
+          int *group_num = nullptr);
+
+  /**
+   * Parse alternatives until ')' or the end of the regex.
+   *
+   * @param begin It is moved to the first character not parsed.
+   * @param end
+   * @param group_index index of the next group. Every group parsed
+   * increases it.
+   * @param resource
+   * @return the AST, or nullptr if the alternatives are invalid
+   */
+  static AstNodePtr<T> ParseAlternative(StrConstIt<T> &begin,
+                                        StrConstIt<T> end, int &group_index,
+                                        std::pmr::memory_resource *resource);
+
+  /**
+   * Parse quantified atoms until '|', ')' or the end of the regex.
+   *
+   * @return the AST, or nullptr if the sequence is empty or invalid
+   */
+  static AstNodePtr<T> ParseSequence(StrConstIt<T> &begin, StrConstIt<T> end,
+                                     int &group_index,
+                                     std::pmr::memory_resource *resource);
+
+  /**
+   * Parse a group, a passive group or a lookahead.
+   *
+   * @param begin It points to '(' and is moved to the character after ')'.
+   * @return the AST, or nullptr if the group is invalid
+   */
+  static AstNodePtr<T> ParseGroup(StrConstIt<T> &begin, StrConstIt<T> end,
+                                  int &group_index,
+                                  std::pmr::memory_resource *resource);
 
   /**
    * Add a new state to exchange_map_. Now it has no edges.
+   *
+   * @param state_num number of states created in the current compilation.
+   * The new state takes it as its id and then it is increased.
+   * @return the new state
    */
-  void NewState();
+  int NewState(int &state_num);
 
   /**
-   * We use i_ to generate a new state. First state should have a id 1.
-   * After that, it will be increased when creating a new state. i_
-   * points to the lastly added state at any time after creating the
-   * first state.
+   * Pack exchange_map_ and functional states into flat arrays and release
+   * the maps once the NFA is built. States are renumbered from 0 in
+   * ascending order, so the order of edges is kept. A frozen NFA is only
+   * used for matching and can't be combined with other NFAs.
+   *
+   * @param states States that should be renumbered as well, e.g. accept
+   * states of regexes in a set. Negative ones are kept. It can be nullptr.
+   */
+  void Freeze(std::vector<int> *states = nullptr);
+
+  /**
+   * @return number of states of a frozen NFA
+   */
+  [[nodiscard]] int GetStateNum() const {
+    return edge_offsets_.empty() ? 0 : edge_offsets_.size() - 1;
+  }
+
+  /**
+   * @param state a state of a frozen NFA
+   * @return character edges of state sorted by their ranges
+   */
+  [[nodiscard]] std::span<const Edge> GetEdges(int state) const {
+    return {edges_.data() + edge_offsets_[state],
+            edges_.data() + edge_offsets_[state + 1]};
+  }
+
+  /**
+   * @param state a state of a frozen NFA
+   * @return States that AddThread adds to a list for a thread at state in
+   * the order they are added. It is empty if the closure contains an
+   * assertion, which depends on the location, or is too large.
+   */
+  [[nodiscard]] std::span<const int> GetClosure(int state) const {
+    return {closures_.data() + closure_offsets_[state],
+            closures_.data() + closure_offsets_[state + 1]};
+  }
+
+  /**
+   * @param state a state of a frozen NFA
+   * @return states reached from state through empty edges in ascending
+   * order
    */
-  static int i_;
+  [[nodiscard]] std::span<const int> GetEmptyEdges(int state) const {
+    return {empty_edges_.data() + empty_edge_offsets_[state],
+            empty_edges_.data() + empty_edge_offsets_[state + 1]};
+  }
 
   /**
    * Record several continuous character ranges. Ranges are stored
@@ -231,28 +605,286 @@ class Nfa {
    */
   std::vector<unsigned int> char_ranges_;
 
+  // It maps a character to its range in char_ranges_ or -1 if it is out of
+  // the encoding, so a frozen NFA finds the range of an ASCII character
+  // with a single load. It is built by Freeze.
+  CharClassMap<T> char_locations_;
+
   /**
    * map.first -- state
-   * map.second.element -- reachable states from an input character that
-   * is in the corresponding range
+   * map.second -- range index in char_ranges_ to reachable states from an
+   * input character that is in the range. Only ranges with edges are
+   * stored, so a state costs nothing for ranges it doesn't use.
    */
-  std::map<int, std::vector<std::set<int>>> exchange_map_;
+  std::map<int, std::map<int, std::set<int>>> exchange_map_;
+
+  // Edges of a frozen NFA. Character edges of state are in
+  // [edge_offsets_[state], edge_offsets_[state + 1]) of edges_, and so are
+  // its empty edges in empty_edges_.
+  std::vector<int> edge_offsets_;
+  std::vector<Edge> edges_;
+  std::vector<int> empty_edge_offsets_;
+  std::vector<int> empty_edges_;
+  // closures of states in the same layout, computed by Freeze
+  std::vector<int> closure_offsets_;
+  std::vector<int> closures_;
 
   /**
    * We compress an assertion to an assertion state in the NFA and it is
    * connected to other states through empty edges. So we need a map to
    * connect the assertion state to the corresponding assertion NFA.
+   *
+   * These maps are only used while the NFA is built. Freeze moves them to
+   * the vectors below.
    */
   std::map<int, AssertionNfa<T>> assertion_states_;
 
-  std::map<int, GroupNfa<T>> group_states_;
+  std::map<int, Tag> tag_states_;
+
+  std::map<int, Counter> counter_states_;
 
   std::map<int, SpecialPatternNfa<T>> special_pattern_states_;
 
   std::map<int, RangeNfa<T>> range_states_;
 
+  // Functional states of a frozen NFA. state_infos_[state] tells the type
+  // of state and where its payload is, so a state is dispatched with a
+  // single load.
+  std::vector<StateInfo> state_infos_;
+  std::vector<AssertionNfa<T>> assertion_nfas_;
+  std::vector<Tag> tags_;
+  std::vector<Counter> counters_;
+  std::vector<SpecialPatternNfa<T>> special_pattern_nfas_;
+  std::vector<RangeNfa<T>> range_nfas_;
+
   int begin_state_{-1};
   int accept_state_{-1};
+
+  // number of sub-match slots carried by every thread
+  int group_num_{0};
+  // number of counters carried by every thread, set by Freeze
+  int counter_num_{0};
+};
+
+/**
+ * Buffers used by matching with a NFA: thread lists of every location,
+ * the stack of AddThread, slot rows of threads and the slots of the matched
+ * sub-matches, as well as threads of DFA searches. Lookaheads run with a nested scratch and a lazy DFA keeps
+ * its states here, so matching never writes to the automaton, and an
+ * automaton can be shared by threads that pass their own scratches.
+ *
+ * Buffers keep their capacity between calls, so a caller that keeps a
+ * scratch, e.g. one per thread, and passes it to every match call stops
+ * allocating after the first few calls. A scratch can be used with any
+ * automaton, but only by one call at a time. It only caches the states of
+ * the last lazy DFA it is used with.
+ *
+ * Copying a scratch copies no buffers, so objects holding one stay
+ * copyable.
+ */
+template<class T>
+class MatchScratch {
+ public:
+  MatchScratch() = default;
+
+  MatchScratch(const MatchScratch &) {}
+
+  MatchScratch(MatchScratch &&) noexcept = default;
+
+  MatchScratch &operator=(const MatchScratch &) {
+    return *this;
+  }
+
+  MatchScratch &operator=(MatchScratch &&) noexcept = default;
+
+ private:
+  friend class Nfa<T>;
+
+  friend class AssertionNfa<T>;
+
+  friend class LazyDfa<T>;
+
+  template<class U, class Transit, class IsAccepted, class BeforeStep>
+  friend bool DfaSearch(StrConstIt<U> begin, StrConstIt<U> end,
+                        int start_state, int dead_state, Transit transit,
+                        IsAccepted is_accepted, BeforeStep before_step,
+                        const Prefilter<U> *prefilter,
+                        bool is_empty_allowed, MatchScratch<U> &scratch,
+                        SubMatch<U> &match, int &match_state);
+
+  // Lists are keyed by their locations and the beginning of their threads,
+  // which is the beginning of the run unless threads with different
+  // beginnings are kept apart.
+  using ThreadLists = std::map<std::pair<StrConstIt<T>, StrConstIt<T>>,
+          typename Nfa<T>::ThreadList>;
+
+  /**
+   * Release all rows and set the width of a row for a new run.
+   *
+   * @param slot_num
+   * @param counter_num
+   */
+  void ResetRows(int slot_num, int counter_num) {
+    slot_num_ = slot_num;
+    counter_num_ = counter_num;
+    row_num_ = 0;
+    free_rows_.clear();
+    key_.resize(1 + counter_num);
+  }
+
+  /**
+   * @return a row referenced once, or -1 if rows have no slots and
+   * counters. Its slots and counters are undefined.
+   */
+  int NewRow() {
+    if (slot_num_ == 0 && counter_num_ == 0) {
+      return -1;
+    }
+    int row;
+    if (!free_rows_.empty()) {
+      row = free_rows_.back();
+      free_rows_.pop_back();
+    } else {
+      row = row_num_++;
+      if (refs_.size() < static_cast<std::size_t>(row_num_)) {
+        refs_.resize(row_num_);
+      }
+      if (slots_.size() < static_cast<std::size_t>(row_num_) * slot_num_) {
+        slots_.resize(static_cast<std::size_t>(row_num_) * slot_num_);
+      }
+      if (counters_.size() <
+          static_cast<std::size_t>(row_num_) * counter_num_) {
+        counters_.resize(static_cast<std::size_t>(row_num_) * counter_num_);
+      }
+    }
+    refs_[row] = 1;
+    return row;
+  }
+
+  /**
+   * @return row, which gets one more reference
+   */
+  int Share(int row) {
+    if (row != -1) {
+      ++refs_[row];
+    }
+    return row;
+  }
+
+  void Release(int row) {
+    if (row != -1 && --refs_[row] == 0) {
+      free_rows_.push_back(row);
+    }
+  }
+
+  /**
+   * @param row a row referenced by the caller
+   * @return a row only referenced by the caller with the same slots and
+   * counters. It is row itself if nobody else references it.
+   */
+  int Unshare(int row) {
+    if (row == -1 || refs_[row] == 1) {
+      return row;
+    }
+    --refs_[row];
+    int new_row = NewRow();
+    std::copy_n(Slots(row), slot_num_, Slots(new_row));
+    std::copy_n(Counters(row), counter_num_, Counters(new_row));
+    return new_row;
+  }
+
+  StrConstIt<T> *Slots(int row) {
+    return slots_.data() + static_cast<std::size_t>(row) * slot_num_;
+  }
+
+  int *Counters(int row) {
+    return counters_.data() + static_cast<std::size_t>(row) * counter_num_;
+  }
+
+  /**
+   * @return state followed by the counters of row, valid until the next
+   * call
+   */
+  std::span<const int> Key(int state, int row) {
+    key_[0] = state;
+    std::copy_n(Counters(row), counter_num_, key_.begin() + 1);
+    return key_;
+  }
+
+  /**
+   * @param row
+   * @param group_num
+   * @return the first group_num sub-matches of row, slot 2 * i and 2 * i + 1
+   * being the ends of sub-match i
+   */
+  std::span<const StrConstIt<T>> SubMatches(int row, int group_num) {
+    if (row == -1) {
+      return {};
+    }
+    return {Slots(row), static_cast<std::size_t>(2 * group_num)};
+  }
+
+  /**
+   * @return scratch of lookaheads run by a run using this scratch. A
+   * lookahead finishes before another one begins, so they share it.
+   */
+  MatchScratch &LookaheadScratch() {
+    if (!lookahead_scratch_) {
+      lookahead_scratch_ = std::make_unique<MatchScratch>();
+    }
+    return *lookahead_scratch_;
+  }
+
+  /**
+   * Copy the sub-matches of row to sub_matches, which keeps its capacity.
+   */
+  void CopySubMatches(int row, int group_num,
+                      std::vector<SubMatch<T>> &sub_matches) {
+    sub_matches.resize(group_num);
+    auto slots = SubMatches(row, group_num);
+    for (int i = 0; i < group_num; ++i) {
+      sub_matches[i] = {slots[2 * i], slots[2 * i + 1]};
+    }
+  }
+
+  // lists being handled and lists kept for reuse
+  ThreadLists thread_lists_;
+  std::vector<typename ThreadLists::node_type> spare_lists_;
+  typename Nfa<T>::ThreadList begin_list_;
+  std::vector<typename Nfa<T>::Thread> thread_stack_;
+  std::vector<typename Nfa<T>::Thread> next_threads_;
+
+  // Rows of threads. Row r is slots_[r * slot_num_, (r + 1) * slot_num_)
+  // with counters_[r * counter_num_, (r + 1) * counter_num_) and is
+  // referenced by refs_[r] threads. Released rows are kept in free_rows_
+  // for reuse, so a thread forking costs a reference and a row is only
+  // copied when a thread writes it while it is shared.
+  std::vector<StrConstIt<T>> slots_;
+  std::vector<int> counters_;
+  std::vector<int> refs_;
+  std::vector<int> free_rows_;
+  int row_num_{0};
+  int slot_num_{0};
+  int counter_num_{0};
+  // buffer of Key
+  std::vector<int> key_;
+
+  // the match returned by Nfa<T>::NextMatch and Nfa<T>::Search
+  State<T> match_;
+
+  std::unique_ptr<MatchScratch> lookahead_scratch_;
+
+  // states of the last lazy DFA using the scratch
+  DfaCache dfa_cache_;
+
+  // threads of DfaSearch, which hold their beginnings and DFA states
+  std::vector<std::pair<StrConstIt<T>, int>> dfa_threads_;
+  std::vector<std::pair<StrConstIt<T>, int>> dfa_next_threads_;
+  // dfa_step_of_state_[state] -- the last step where a thread of DfaSearch
+  // reaches state. Steps keep growing between searches, so it needn't be
+  // reset.
+  std::vector<int> dfa_step_of_state_;
+  int dfa_step_{-1};
 };
 
 /**
@@ -263,16 +895,27 @@ class AssertionNfa {
  public:
   AssertionNfa(const AssertionNfa &assertion_nfa) = default;
 
-  explicit AssertionNfa(const std::basic_string<T> &assertion);
+  AssertionNfa(AssertionNfa &&assertion_nfa) noexcept = default;
+
+  /**
+   * @param assertion ^ $ \\b \\B (?= (?!
+   * @param sub_pattern AST of the sub-pattern of a lookahead. It is
+   * nullptr for other assertions.
+   * @param group_num number of groups in the lookahead
+   */
+  AssertionNfa(std::basic_string_view<T> assertion,
+               AstNodePtr<T> &sub_pattern, int group_num);
 
   /**
    * @param str_begin location of ^ in regex in a match
    * @param str_end location of $ in regex in a match
    * @param begin where to start the assertion
+   * @param scratch scratch of the run checking the assertion. A lookahead
+   * runs with its nested scratch.
    * @return
    */
   bool IsSuccess(StrConstIt<T> str_begin, StrConstIt<T> str_end,
-                 StrConstIt<T> begin);
+                 StrConstIt<T> begin, MatchScratch<T> &scratch) const;
 
  private:
   enum class AssertionType {
@@ -285,47 +928,50 @@ class AssertionNfa {
   Nfa<T> nfa_;
 };
 
-/**
- * It stores a NFA for the sub-pattern in the group.
- */
-template<class T>
-class GroupNfa : public Nfa<T> {
- public:
-  GroupNfa(const GroupNfa &group_nfa) = default;
-
-  explicit GroupNfa(const std::basic_string<T> &regex) : Nfa<T>(regex) {}
-
-  /**
-   * Get all possible sub-matches from the group.
-   *
-   * @param begin
-   * @param str_end
-   * @return possible end iterators after dealing with the group
-   */
-  std::set<StrConstIt<T>> NextMatch(StrConstIt<T> begin, StrConstIt<T> str_end);
-};
-
 /**
  * Escape characters, special meaning escape characters and back-reference.
  */
 template<class T>
 class SpecialPatternNfa {
  public:
-  explicit SpecialPatternNfa(std::basic_string<T> characters)
-          : characters_(std::move(characters)) {}
+  explicit SpecialPatternNfa(std::basic_string<T> characters);
+
+  [[nodiscard]] bool IsBackReference() const {
+    return characters_.size() > 1 && characters_[0] == kReverseSolidus &&
+           characters_[1] >= '0' && characters_[1] <= '9' &&
+           characters_ != std::basic_string<T>{kReverseSolidus, '0'};
+  }
 
   /**
    * Determine whether a substring can match characters_.
    *
    * @param begin
    * @param str_end
+   * @param slots sub-match slots of the thread, which a back-reference
+   * refers to
    * @return If a substring [begin, end_it) matches, return end_it.
    * Otherwise return begin.
    */
-  StrConstIt<T> NextMatch(const State<T> &state, StrConstIt<T> str_end);
+  StrConstIt<T> NextMatch(StrConstIt<T> begin, StrConstIt<T> str_end,
+                          std::span<const StrConstIt<T>> slots = {}) const;
+
+  /**
+   * @return characters matched by a special pattern that isn't a
+   * back-reference
+   */
+  [[nodiscard]] const CharSet<T> &GetCharSet() const {
+    return char_set_;
+  }
 
  private:
   std::basic_string<T> characters_;
+
+  // It is compiled from characters_ once, so a character is matched with a
+  // single bit test. It is empty for a back-reference.
+  CharSet<T> char_set_;
+
+  // index of the group for a back-reference
+  int back_reference_{0};
 };
 
 /**
@@ -333,44 +979,133 @@ class SpecialPatternNfa {
  */
 template<class T>
 class RangeNfa {
+  friend class Nfa<T>;
+
+  friend class ClassNfa<T>;
+
+  friend class GlushkovNfa<T>;
+
+  friend class LiteralExtractor<T>;
+
  public:
   explicit RangeNfa(const std::basic_string<T> &regex);
 
   /**
    * @param begin
    * @param str_end
+   * @param slots the same as the one of SpecialPatternNfa<T>::NextMatch
    * @return If a substring [begin, end_it) matches, return end_it.
    * Otherwise return begin.
    */
-  StrConstIt<T> NextMatch(const State<T> &state, StrConstIt<T> str_end);
+  StrConstIt<T> NextMatch(StrConstIt<T> begin, StrConstIt<T> str_end,
+                          std::span<const StrConstIt<T>> slots = {}) const;
 
  private:
-  std::map<int, int> ranges_;
+  // Ranges [first, last] of code points in the order they are written. A
+  // single character c is [c, c].
+  std::vector<std::pair<unsigned int, unsigned int>> ranges_;
   std::vector<SpecialPatternNfa<T>> special_patterns_;
   bool except_;  // true for [^...] and false for [...]
+
+  // Characters matched by the whole range, compiled once. A back-reference
+  // may match several characters, so if there is one, it only holds ranges_
+  // and special patterns are tried in order.
+  CharSet<T> char_set_;
+  bool has_back_reference_{false};
 };
 
 /**
  * Provide a function to create a sub-NFA for common operators in the
  * RegexPart. It's usually used to create NFAs for split parts.
+ *
+ * Every compilation numbers its states from 0 with its own counter
+ * 'state_num', which is passed to every function creating states, so
+ * compilations in different threads share nothing.
  */
 template<class T>
 class NfaFactory {
+  friend class GlushkovNfa<T>;
+
+  friend class LiteralExtractor<T>;
+
  public:
-  static Nfa<T> MakeCharacterNfa(const std::basic_string<T> &characters,
-                                 const std::vector<unsigned int> &char_ranges);
+  static Nfa<T> MakeCharacterNfa(std::basic_string_view<T> characters,
+                                 const std::vector<unsigned int> &char_ranges,
+                                 int &state_num);
 
-  static Nfa<T> MakeAlternativeNfa(Nfa<T> left_nfa, Nfa<T> right_nfa);
+  static Nfa<T> MakeAlternativeNfa(Nfa<T> left_nfa, Nfa<T> right_nfa,
+                                   int &state_num);
 
   static Nfa<T> MakeAndNfa(Nfa<T> left_nfa, Nfa<T> right_nfa);
 
+  /**
+   * Build a NFA for a group. The NFA of its sub-pattern is put between two
+   * tag states, which record where the group begins and ends.
+   *
+   * @param group AST of the group
+   * @param char_ranges
+   * @param state_num
+   * @return
+   */
+  static Nfa<T> MakeGroupNfa(AstNodePtr<T> &group,
+                             const std::vector<unsigned int> &char_ranges,
+                             int &state_num);
+
+  /**
+   * A repetition is unrolled to copies of the sub-pattern, which DFAs
+   * support. If the copies would have more than kMaxRepeatStates states,
+   * the sub-pattern is built once between two counter states instead.
+   *
+   * @param repeat_range [min, max] times of repetitions
+   * @param left AST of the repeated sub-pattern
+   * @param char_ranges
+   * @param state_num
+   * @return
+   */
   static Nfa<T>
-  MakeQuantifierNfa(const std::basic_string<T> &quantifier, AstNodePtr<T> &left,
-                    const std::vector<unsigned int> &char_ranges);
+  MakeQuantifierNfa(std::pair<int, int> repeat_range, AstNodePtr<T> &left,
+                    const std::vector<unsigned int> &char_ranges,
+                    int &state_num);
+
+  /**
+   * Build a NFA for the alternation of 'regexes' with MakeAlternativeNfa.
+   * A set has no sub-matches, so groups are matched as passive groups.
+   * Regexes that are invalid or contain assertions, back-references or
+   * repetitions too large to be unrolled are left out. The accept state of
+   * every regex is kept as a common state, so it tells which regex is
+   * matched.
+   *
+   * @param regexes
+   * @param accept_states accept state of every regex, or -1 if it is left
+   * out
+   * @return a frozen NFA. It is empty if all regexes are left out.
+   */
+  static Nfa<T> MakeSetNfa(const std::vector<std::basic_string<T>> &regexes,
+                           std::vector<int> &accept_states);
 
  private:
-  static std::pair<int, int>
-  ParseQuantifier(const std::basic_string<T> &quantifier);
+  // upper bound of states of an unrolled repetition
+  static constexpr int kMaxRepeatStates = 512;
+
+  /**
+   * Merge states of two NFAs. States of the smaller one are moved to the
+   * larger one, so a long chain of alternatives or concatenations, e.g. a
+   * list of keywords, is built in O(n log n) instead of O(n^2) time.
+   *
+   * @param left_nfa
+   * @param right_nfa
+   * @return an NFA holding states of both NFAs
+   */
+  static Nfa<T> Merge(Nfa<T> &left_nfa, Nfa<T> &right_nfa);
+
+  /**
+   * Replace groups in the AST with the ASTs of their sub-patterns.
+   *
+   * @param ast_head
+   * @param delim characters of the AST are added to it
+   */
+  static void InlineGroups(AstNodePtr<T> &ast_head,
+                           std::set<std::basic_string_view<T>> &delim);
 };
 
 /**
@@ -383,10 +1118,16 @@ template<class T>
 class AstNode {
   friend class Nfa<T>;
 
+  friend class GlushkovNfa<T>;
+
+  friend class LiteralExtractor<T>;
+
+  friend class NfaFactory<T>;
+
  public:
-  AstNode(RegexPart regex_type, std::basic_string<T> regex)
+  AstNode(RegexPart regex_type, std::basic_string_view<T> regex)
           : regex_type_(regex_type),
-            regex_(std::move(regex)) {}
+            regex_(regex) {}
 
   void SetLeftSon(AstNodePtr<T> left_son) {
     left_son_ = std::move(left_son);
@@ -402,12 +1143,23 @@ class AstNode {
 
  private:
   RegexPart regex_type_;
-  std::basic_string<T> regex_;
+  // Text of a character or an assertion, which is a view of the regex, so
+  // the regex should outlive the AST. It is empty for a group.
+  std::basic_string_view<T> regex_;
+  std::pair<int, int> repeat_range_;  // only used by kQuantifier
+  int group_index_{0};  // only used by kGroup
+  // index of the first group after a group, or number of groups in a
+  // lookahead
+  int group_end_{0};
   AstNodePtr<T> left_son_;
   AstNodePtr<T> right_son_;
 };
 
-template<class T> int Nfa<T>::i_ = 0;
+template<class T>
+void AstNodeDeleter<T>::operator()(AstNode<T> *node) const {
+  node->~AstNode();
+  resource->deallocate(node, sizeof(AstNode<T>), alignof(AstNode<T>));
+}
 
 /**
 * It determines which RegexPart should be chosen according to regex's a few
@@ -417,10 +1169,19 @@ template<class T> int Nfa<T>::i_ = 0;
 * @return
 */
 template<class T>
-RegexPart GetRegexType(const std::basic_string<T> &regex);
+RegexPart GetRegexType(std::basic_string_view<T> regex);
 
+/**
+ * @param quantifier * + ? {n} {n,} {n,m}. * + ? may be followed by ? for
+ * the non-greedy mode, which is matched like the greedy one since the
+ * longest match is always returned.
+ * @param repeat_range [min, max] times of repetitions. max is INT_MAX if
+ * it has no upper bound.
+ * @return whether quantifier is valid
+ */
 template<class T>
-std::set<std::basic_string<T>> GetDelim(const std::basic_string<T> &regex);
+bool ParseQuantifier(std::basic_string_view<T> quantifier,
+                     std::pair<int, int> &repeat_range);
 
 /**
  * Add a character range [begin, end) to char_ranges.
@@ -445,11 +1206,12 @@ void AddCharRange(std::set<unsigned int> &char_ranges, unsigned int begin);
 * @param begin Always point to the begin of the next token. If no valid
 * token remains, it points to 'iterator.cend()'.
 * @param end Always point to the end of the given regex.
-* @return A valid token. If it finds an invalid token or reaching to the end
- * of the regex, it returns "".
+* @return A valid token, which is a view of the regex. If it finds an
+ * invalid token or reaching to the end of the regex, it returns "".
 */
 template<class T>
-std::basic_string<T> NextToken(StrConstIt<T> &begin, StrConstIt<T> &end);
+std::basic_string_view<T> NextToken(StrConstIt<T> &begin,
+                                    StrConstIt<T> &end);
 
 /**
  * @param begin
@@ -460,19 +1222,18 @@ std::basic_string<T> NextToken(StrConstIt<T> &begin, StrConstIt<T> &end);
 template<class T>
 StrConstIt<T> SkipEscapeCharacters(StrConstIt<T> begin, StrConstIt<T> end);
 
+/**
+ * Create an AST node in resource.
+ *
+ * @param resource
+ * @param regex_type
+ * @param regex
+ * @return
+ */
 template<class T>
-bool PushAnd(std::stack<AstNodePtr<T>> &op_stack,
-             std::stack<AstNodePtr<T>> &rpn_stack);
-
-template<class T>
-bool
-PushOr(std::stack<AstNodePtr<T>> &op_stack,
-       std::stack<AstNodePtr<T>> &rpn_stack);
-
-template<class T>
-bool PushQuantifier(std::stack<AstNodePtr<T>> &op_stack,
-                    std::stack<AstNodePtr<T>> &rpn_stack,
-                    const std::basic_string<T> &regex);
+AstNodePtr<T> MakeAstNode(std::pmr::memory_resource *resource,
+                          RegexPart regex_type,
+                          std::basic_string_view<T> regex);
 
 template<class T>
 bool IsLineTerminator(StrConstIt<T> it);
@@ -481,198 +1242,537 @@ template<class T>
 bool IsWord(StrConstIt<T> it);
 
 template<class T>
-StatePtr<T> Nfa<T>::NextMatch(StrConstIt<T> begin, StrConstIt<T> end) {
-  using namespace std;
-
-  vector<ReachableStatesMap<T>> state_vec = StateRoute(begin, end);
-  auto it = state_vec.cbegin();
-  State<T> state = *state_vec[0].find({begin_state_, begin});
-
-  // find the longest match
-  while (it != state_vec.cend()) {
-    for (const auto &cur_state:*it) {
-      if (cur_state.first.first == accept_state_ &&
-          cur_state.first.second >= state.first.second) {
-        state = cur_state;
-      }
-    }
-    it++;
-  }
+StatePtr<T> Nfa<T>::NextMatch(StrConstIt<T> begin,
+                              StrConstIt<T> end) const {
+  MatchScratch<T> scratch;
+  auto state = NextMatch(begin, end, scratch);
+  return state == nullptr ? nullptr : std::make_unique<State<T>>(*state);
+}
 
-  if (state.first.first == begin_state_) {
+template<class T>
+const State<T> *Nfa<T>::NextMatch(StrConstIt<T> begin, StrConstIt<T> end,
+                                  MatchScratch<T> &scratch) const {
+  if (Empty()) {
     return nullptr;
-  } else {
-    return make_unique<State<T>>(state);
   }
+
+  // Accepted threads come in ascending order of locations, so the last one
+  // is the longest match. It is copied to the buffer of scratch, which
+  // keeps its capacity.
+  bool is_matched = false;
+  auto &longest_match = scratch.match_;
+  RunThreads(begin, end, false,
+             [this, &is_matched, &longest_match, &scratch](
+                     const Thread &thread, StrConstIt<T>) {
+               is_matched = true;
+               longest_match.first = {thread.state, thread.location};
+               scratch.CopySubMatches(thread.row, group_num_,
+                                      longest_match.second);
+             }, scratch);
+
+  return is_matched ? &longest_match : nullptr;
 }
 
 template<class T>
-std::vector<ReachableStatesMap<T>>
-Nfa<T>::StateRoute(StrConstIt<T> begin, StrConstIt<T> end) {
-  using namespace std;
-
-  vector<ReachableStatesMap<T>> state_vec;
-  ReachableStatesMap<T> cur_states;
+StatePtr<T> Nfa<T>::Search(StrConstIt<T> begin, StrConstIt<T> end,
+                           StrConstIt<T> &match_begin,
+                           const Prefilter<T> *prefilter) const {
+  MatchScratch<T> scratch;
+  auto state = Search(begin, end, match_begin, scratch, prefilter);
+  return state == nullptr ? nullptr : std::make_unique<State<T>>(*state);
+}
 
-  // Use states that can be accessed through empty edges from begin_state_
-  // and begin_state_ itself as an initial driver.
-  State<T> begin_state = {{begin_state_, begin}, vector<SubMatch<T>>()};
-  if (GetStateType(begin_state_) == StateType::kCommon) {
-    cur_states.merge(NextState(begin_state));
+template<class T>
+const State<T> *Nfa<T>::Search(StrConstIt<T> begin, StrConstIt<T> end,
+                               StrConstIt<T> &match_begin,
+                               MatchScratch<T> &scratch,
+                               const Prefilter<T> *prefilter) const {
+  if (Empty()) {
+    return nullptr;
   }
-  cur_states.insert(begin_state);
-  state_vec.push_back(cur_states);
 
-  // find all reachable states from current states
-  while (!state_vec[state_vec.size() - 1].empty()) {
-    cur_states.clear();
-    for (const auto &last_state:state_vec[state_vec.size() - 1]) {
-      cur_states.merge(NextState(last_state, begin, end));
+  if (HasBackReference()) {
+    // Every match is a match of the relaxed run, so the run below begins at
+    // its leftmost beginning.
+    bool is_candidate = false;
+    StrConstIt<T> candidate;
+    RunThreads(begin, end, true,
+               [&is_candidate, &candidate](const Thread &,
+                                           StrConstIt<T> thread_begin) {
+                 if (!is_candidate || thread_begin < candidate) {
+                   is_candidate = true;
+                   candidate = thread_begin;
+                 }
+               }, scratch, prefilter, true);
+    if (!is_candidate) {
+      return nullptr;
     }
-    state_vec.push_back(cur_states);
+    begin = candidate;
   }
-  // remove the last empty vector
-  state_vec.pop_back();
 
-  return state_vec;
+  // Threads beginning later than a reported one are never reported, so a
+  // later thread is either leftmost or longer.
+  bool is_matched = false;
+  auto &leftmost_match = scratch.match_;
+  RunThreads(begin, end, true,
+             [this, &is_matched, &leftmost_match, &match_begin, &scratch](
+                     const Thread &thread, StrConstIt<T> thread_begin) {
+               is_matched = true;
+               leftmost_match.first = {thread.state, thread.location};
+               scratch.CopySubMatches(thread.row, group_num_,
+                                      leftmost_match.second);
+               match_begin = thread_begin;
+             }, scratch, prefilter);
+
+  return is_matched ? &leftmost_match : nullptr;
 }
 
 template<class T>
-ReachableStatesMap<T>
-Nfa<T>::NextState(const State<T> &cur_state,
-                  StrConstIt<T> str_begin, StrConstIt<T> str_end) {
-  ReachableStatesMap<T> next_states;
-  auto begin = cur_state.first.second;
+template<class AcceptCallback>
+void Nfa<T>::RunThreads(StrConstIt<T> begin, StrConstIt<T> end,
+                        bool is_unanchored, AcceptCallback accept,
+                        MatchScratch<T> &scratch,
+                        const Prefilter<T> *prefilter,
+                        bool is_relaxed) const {
+  using namespace std;
 
-  switch (GetStateType(cur_state.first.first)) {
-    case StateType::kAssertion:
-      if (!assertion_states_.find(cur_state.first.first)->second.IsSuccess(
-              str_begin, str_end, begin)) {
-        return next_states;
+  auto &thread_lists = scratch.thread_lists_;
+  // Handled lists are kept with their buffers and reused by later
+  // locations.
+  auto &spare_lists = scratch.spare_lists_;
+  // A list from the scratch may have been used by a smaller NFA.
+  int state_num = GetStateNum();
+  int key_width = 1 + counter_num_;
+  // Sub-matches decide how a back-reference goes on, so threads with
+  // different beginnings are kept apart unless the run is relaxed.
+  bool is_keyed_by_begin = is_unanchored && !is_relaxed && HasBackReference();
+  auto list_key = [is_keyed_by_begin, begin](StrConstIt<T> location,
+                                             StrConstIt<T> thread_begin) {
+    return pair(location, is_keyed_by_begin ? thread_begin : begin);
+  };
+  // Threads of a list mostly go to the same list, so the last list got is
+  // checked first.
+  auto last_it = thread_lists.end();
+  auto get_list = [&thread_lists, &spare_lists, &list_key, &last_it,
+                   state_num, key_width](
+          StrConstIt<T> location, StrConstIt<T> thread_begin) -> ThreadList & {
+    auto key = list_key(location, thread_begin);
+    if (last_it != thread_lists.end() && last_it->first == key) {
+      return last_it->second;
+    }
+    auto it = thread_lists.lower_bound(key);
+    if (it != thread_lists.end() && it->first == key) {
+      last_it = it;
+      return it->second;
+    }
+    if (spare_lists.empty()) {
+      it = thread_lists.emplace_hint(it, key, ThreadList());
+    } else {
+      auto node = std::move(spare_lists.back());
+      spare_lists.pop_back();
+      node.key() = key;
+      it = thread_lists.insert(it, std::move(node));
+    }
+    last_it = it;
+    auto list = &it->second;
+    if (list->states.Capacity() < state_num) {
+      list->states.Resize(state_num);
+    }
+    if (list->counted_states.Width() != key_width) {
+      list->counted_states.Reset(key_width);
+    }
+    return *list;
+  };
+  get_list(begin, begin);
+  scratch.ResetRows(2 * group_num_, counter_num_);
+  auto &begin_list = scratch.begin_list_;
+  // locations reached by a functional state with their sub-matches
+  auto &next_threads = scratch.next_threads_;
+  // beginning of the leftmost accepted thread
+  bool is_accepted = false;
+  StrConstIt<T> accepted_begin;
+  // locations before it are known to be candidates of prefilter
+  auto candidates_end = begin;
+
+  while (!thread_lists.empty()) {
+    auto cur_it = thread_lists.begin();
+    // Without alive threads, no match begins before the next candidate.
+    if (prefilter != nullptr && is_unanchored && !is_accepted &&
+        thread_lists.size() == 1 && cur_it->second.threads.empty() &&
+        cur_it->first.first >= candidates_end) {
+      auto candidates = prefilter->Find(cur_it->first.first, end);
+      if (candidates.first == end) {
+        break;
       }
-      next_states.insert(cur_state);
-      break;
-    case StateType::kGroup:
-      for (auto end_it:
-              group_states_.find(cur_state.first.first)->second.NextMatch(
-                      begin, str_end)) {
-        auto sub_matches = cur_state.second;
-        sub_matches.emplace_back(begin, end_it);
-        next_states.insert({{cur_state.first.first, end_it}, sub_matches});
+      candidates_end = candidates.second;
+      last_it = thread_lists.end();
+      auto node = thread_lists.extract(cur_it);
+      node.key() = list_key(candidates.first, candidates.first);
+      node.mapped().Clear();
+      cur_it = thread_lists.insert(std::move(node)).position;
+    }
+    auto cur = cur_it->first.first;
+    auto &cur_list = cur_it->second;
+
+    // A thread beginning at cur is added to the last list at cur.
+    bool is_injected = is_unanchored ? !is_accepted && cur != end &&
+                                       cur_it->first == list_key(cur, cur)
+                                     : cur == begin;
+    if (is_injected) {
+      // Assertions may behave differently for a thread beginning at cur, so
+      // it isn't merged with earlier threads here.
+      int row = scratch.NewRow();
+      if (row != -1) {
+        fill_n(scratch.Slots(row), 2 * group_num_, end);
+        fill_n(scratch.Counters(row), counter_num_, 0);
       }
-      break;
-    case StateType::kSpecialPattern:
-      begin = special_pattern_states_.find(
-              cur_state.first.first)->second.NextMatch(cur_state, str_end);
-      if (begin != cur_state.first.second) {
-        next_states.insert({{cur_state.first.first, begin}, cur_state.second});
+      begin_list.Clear();
+      AddThread(begin_list, {begin_state_, cur, row}, cur, end, scratch,
+                is_relaxed);
+      // A thread at a marked state is never preferred to the earlier one.
+      for (size_t i = 0; i < begin_list.threads.size(); ++i) {
+        const auto &thread = begin_list.threads[i];
+        if (Mark(cur_list, thread.state, thread.row, scratch)) {
+          cur_list.threads.push_back(thread);
+          cur_list.begins.push_back(begin_list.begins[i]);
+        } else {
+          scratch.Release(thread.row);
+        }
       }
-      break;
-    case StateType::kRange:
-      begin = range_states_.find(cur_state.first.first)->second.NextMatch(
-              cur_state, str_end);
-      if (begin != cur_state.first.second) {
-        next_states.insert({{cur_state.first.first, begin}, cur_state.second});
+      for (auto state:begin_list.states) {
+        cur_list.states.Insert(state);
       }
-      break;
-    case StateType::kCommon:
-      // add states that can be reached through *cur_it
-      if (begin < str_end) {
-        for (auto state:exchange_map_[cur_state.first.first][
-                GetCharLocation(*begin)]) {
-          next_states.insert({{state, begin + 1}, cur_state.second});
+      for (int j = 0; j < begin_list.counted_states.Size(); ++j) {
+        cur_list.counted_states.Insert(begin_list.counted_states[j]);
+      }
+      if (is_unanchored && cur + 1 != end) {
+        // a thread is added there even if no threads reach it
+        get_list(cur + 1, cur + 1);
+      }
+    }
+
+    for (size_t i = 0; i < cur_list.threads.size(); ++i) {
+      auto thread = cur_list.threads[i];
+      int state = thread.state;
+      auto thread_begin = cur_list.begins[i];
+      if (is_accepted && (thread_begin > accepted_begin ||
+                          (is_relaxed && thread_begin == accepted_begin))) {
+        scratch.Release(thread.row);
+        continue;
+      }
+      next_threads.clear();
+
+      auto [state_type, payload] = state_infos_[state];
+      if (is_relaxed && IsBackReference(state)) {
+        // It goes on with any character or leaves, which AddThread has
+        // done.
+        if (cur != end) {
+          AddThread(get_list(cur + 1, thread_begin),
+                    {state, cur + 1, thread.row},
+                    thread_begin, end, scratch, true);
+        } else {
+          scratch.Release(thread.row);
         }
+        continue;
+      }
+      switch (state_type) {
+        case StateType::kSpecialPattern: {
+          auto next = special_pattern_nfas_[payload].NextMatch(
+                  cur, end, scratch.SubMatches(thread.row, group_num_));
+          if (next != cur) {
+            next_threads.push_back({state, next, thread.row});
+          } else {
+            scratch.Release(thread.row);
+          }
+          break;
+        }
+        case StateType::kRange: {
+          auto next = range_nfas_[payload].NextMatch(
+                  cur, end, scratch.SubMatches(thread.row, group_num_));
+          if (next != cur) {
+            next_threads.push_back({state, next, thread.row});
+          } else {
+            scratch.Release(thread.row);
+          }
+          break;
+        }
+        case StateType::kCommon: {
+          if (state == accept_state_) {
+            accept(thread, thread_begin);
+            if (!is_accepted || thread_begin < accepted_begin) {
+              is_accepted = true;
+              accepted_begin = thread_begin;
+            }
+          }
+          // Range kEmptyEdge is reserved for empty edges, so '\0' has no
+          // edges here. Characters out of the encoding have no edges either.
+          int location = cur == end ? -1 : char_locations_(*cur);
+          if (location > kEmptyEdge) {
+            // A marked state already has a thread of higher priority, so the
+            // row isn't shared with it.
+            auto &next_list = get_list(cur + 1, thread_begin);
+            for (const auto &edge:GetEdges(state)) {
+              if (edge.char_range == location &&
+                  !IsMarked(next_list, edge.next_state, thread.row,
+                            scratch)) {
+                AddThread(next_list,
+                          {edge.next_state, cur + 1,
+                           scratch.Share(thread.row)},
+                          thread_begin, end, scratch, is_relaxed);
+              }
+            }
+          }
+          scratch.Release(thread.row);
+          break;
+        }
+        case StateType::kAssertion:
+        case StateType::kTag:
+        case StateType::kCounter:
+          // assertions, tags and counters are handled in AddThread
+          scratch.Release(thread.row);
+          break;
       }
-      break;
-  }
 
-  ReachableStatesMap<T> next_states_from_empty;
-  for (const auto &state:next_states) {
-    next_states_from_empty.merge(NextState(state));
-  }
-  next_states.erase({cur_state.first.first, begin});
-  next_states.merge(next_states_from_empty);
+      // A functional state has only empty edges to its following states.
+      auto empty_edges = GetEmptyEdges(state);
+      for (const auto &next_thread:next_threads) {
+        auto next = next_thread.location;
+        auto &next_list = get_list(next, thread_begin);
+        for (auto next_state:empty_edges) {
+          if (!IsMarked(next_list, next_state, next_thread.row, scratch)) {
+            AddThread(next_list,
+                      {next_state, next, scratch.Share(next_thread.row)},
+                      thread_begin, end, scratch, is_relaxed);
+          }
+        }
+        scratch.Release(next_thread.row);
+      }
+    }
 
-  return next_states;
+    if (last_it == cur_it) {
+      last_it = thread_lists.end();
+    }
+    auto node = thread_lists.extract(cur_it);
+    node.mapped().Clear();
+    spare_lists.push_back(std::move(node));
+  }
+  // lists left by a prefilter
+  while (!thread_lists.empty()) {
+    auto node = thread_lists.extract(thread_lists.begin());
+    node.mapped().Clear();
+    spare_lists.push_back(std::move(node));
+  }
 }
 
 template<class T>
-ReachableStatesMap<T> Nfa<T>::NextState(const State<T> &cur_state) {
+void Nfa<T>::AddThread(ThreadList &thread_list, Thread thread,
+                       StrConstIt<T> str_begin, StrConstIt<T> str_end,
+                       MatchScratch<T> &scratch, bool is_relaxed) const {
   using namespace std;
 
-  vector<int> common_states;
-  set<int> func_states;
-
-  common_states.push_back(cur_state.first.first);
-  int i = -1;
-  while (++i != common_states.size()) {
-    for (auto state:exchange_map_[common_states[i]][kEmptyEdge]) {
-      if (GetStateType(state) == StateType::kCommon) {
-        if (find(common_states.cbegin(), common_states.cend(), state) ==
-            common_states.cend()) {
-          common_states.push_back(state);
+  auto &thread_stack = scratch.thread_stack_;
+  thread_stack.push_back(thread);
+
+  // A list from the scratch may have been used by a smaller NFA.
+  if (thread_list.states.Capacity() < GetStateNum()) {
+    thread_list.states.Resize(GetStateNum());
+  }
+  if (thread_list.counted_states.Width() != 1 + counter_num_) {
+    thread_list.counted_states.Reset(1 + counter_num_);
+  }
+  while (!thread_stack.empty()) {
+    auto cur_thread = thread_stack.back();
+    thread_stack.pop_back();
+    int state = cur_thread.state;
+    auto cur = cur_thread.location;
+
+    // A state is only marked when everything reachable from it is visited,
+    // so marked states of a precomputed closure are skipped with what
+    // follows them.
+    auto closure = GetClosure(state);
+    if (!closure.empty()) {
+      for (auto next_state:closure) {
+        if (Mark(thread_list, next_state, cur_thread.row, scratch)) {
+          thread_list.threads.push_back(
+                  {next_state, cur, scratch.Share(cur_thread.row)});
+          thread_list.begins.push_back(str_begin);
         }
+      }
+      scratch.Release(cur_thread.row);
+      continue;
+    }
+
+    // An assertion may succeed for a thread beginning at another location,
+    // so it is only marked when it succeeds.
+    auto [state_type, payload] = state_infos_[state];
+    if ((state_type == StateType::kAssertion &&
+         !assertion_nfas_[payload].IsSuccess(str_begin, str_end, cur,
+                                             scratch)) ||
+        !Mark(thread_list, state, cur_thread.row, scratch)) {
+      scratch.Release(cur_thread.row);
+      continue;
+    }
+
+    // The counters of following states change, so they are checked when
+    // they are popped.
+    if (state_type == StateType::kCounter) {
+      const auto &counter = counters_[payload];
+      auto empty_edges = GetEmptyEdges(state);
+      cur_thread.row = scratch.Unshare(cur_thread.row);
+      if (counter.is_begin) {
+        scratch.Counters(cur_thread.row)[counter.index] = 0;
+        for (auto it = empty_edges.rbegin(); it != empty_edges.rend(); ++it) {
+          thread_stack.push_back({*it, cur, scratch.Share(cur_thread.row)});
+        }
+        scratch.Release(cur_thread.row);
+        continue;
+      }
+
+      // The empty edges are the beginning of x and the exit in order. Like
+      // an unrolled repetition, x may be empty, and marked states stop an
+      // empty loop.
+      int times = scratch.Counters(cur_thread.row)[counter.index] + 1;
+      if (times >= counter.min) {
+        int exit_row = scratch.Unshare(scratch.Share(cur_thread.row));
+        scratch.Counters(exit_row)[counter.index] = 0;
+        thread_stack.push_back({empty_edges.back(), cur, exit_row});
+      }
+      if (times < counter.max) {
+        // An unbounded loop is unrolled to min - 1 copies of x and a copy
+        // repeating itself, so later repetitions share a counter.
+        if (counter.max == INT_MAX) {
+          times = min(times, max(counter.min - 1, 0));
+        }
+        scratch.Counters(cur_thread.row)[counter.index] = times;
+        thread_stack.push_back({empty_edges.front(), cur, cur_thread.row});
+      } else {
+        scratch.Release(cur_thread.row);
+      }
+      continue;
+    }
+
+    if (state_type == StateType::kTag) {
+      // Only this thread sees the tag, so a shared row is copied first.
+      const auto &tag = tags_[payload];
+      cur_thread.row = scratch.Unshare(cur_thread.row);
+      auto slots = scratch.Slots(cur_thread.row);
+      if (tag.is_begin) {
+        // It is empty until the group ends.
+        slots[2 * tag.group] = cur;
+        slots[2 * tag.group + 1] = cur;
+        fill(slots + 2 * tag.group + 2, slots + 2 * tag.group_end, str_end);
       } else {
-        func_states.insert(state);
+        slots[2 * tag.group + 1] = cur;
       }
     }
+    // Common states and back-references of a relaxed run are stepped and
+    // passed through, while other functional states are only stepped.
+    bool is_passed = state_type == StateType::kCommon ||
+                     (is_relaxed && IsBackReference(state));
+    if (!is_passed && state_type != StateType::kTag &&
+        state_type != StateType::kAssertion) {
+      thread_list.threads.push_back(cur_thread);
+      thread_list.begins.push_back(str_begin);
+      continue;
+    }
+
+    if (is_passed) {
+      thread_list.threads.push_back(
+              {state, cur, scratch.Share(cur_thread.row)});
+      thread_list.begins.push_back(str_begin);
+    }
+    // Push in reverse order so that states are visited in ascending order.
+    auto empty_edges = GetEmptyEdges(state);
+    for (auto it = empty_edges.rbegin(); it != empty_edges.rend(); ++it) {
+      if (!IsMarked(thread_list, *it, cur_thread.row, scratch)) {
+        thread_stack.push_back({*it, cur, scratch.Share(cur_thread.row)});
+      }
+    }
+    scratch.Release(cur_thread.row);
+  }
+}
+
+template<class T>
+bool Nfa<T>::IsMarked(const ThreadList &thread_list, int state, int row,
+                      MatchScratch<T> &scratch) const {
+  if (counter_num_ == 0) {
+    return thread_list.states.Contains(state);
   }
-  // erase cur_state
-  common_states.erase(common_states.cbegin());
+  return thread_list.counted_states.Contains(scratch.Key(state, row));
+}
+
+template<class T>
+bool Nfa<T>::Mark(ThreadList &thread_list, int state, int row,
+                  MatchScratch<T> &scratch) const {
+  if (counter_num_ == 0) {
+    return thread_list.states.Insert(state);
+  }
+  return thread_list.counted_states.Insert(scratch.Key(state, row));
+}
+
+template<class T>
+bool Nfa<T>::HasBackReference() const {
+  auto is_back_reference = [](const SpecialPatternNfa<T> &special_pattern) {
+    return special_pattern.IsBackReference();
+  };
+  auto has_back_reference = [&is_back_reference](const RangeNfa<T> &range) {
+    return std::any_of(range.special_patterns_.cbegin(),
+                       range.special_patterns_.cend(), is_back_reference);
+  };
 
-  ReachableStatesMap<T> next_states_map;
-  for (auto state:common_states) {
-    next_states_map.insert({{state, cur_state.first.second}, cur_state.second});
+  // Only one of a map and its vector is non-empty.
+  for (const auto &pair:special_pattern_states_) {
+    if (is_back_reference(pair.second)) {
+      return true;
+    }
   }
-  for (auto state:func_states) {
-    next_states_map.insert({{state, cur_state.first.second}, cur_state.second});
+  for (const auto &pair:range_states_) {
+    if (has_back_reference(pair.second)) {
+      return true;
+    }
   }
-
-  return next_states_map;
+  return std::any_of(special_pattern_nfas_.cbegin(),
+                     special_pattern_nfas_.cend(), is_back_reference) ||
+         std::any_of(range_nfas_.cbegin(), range_nfas_.cend(),
+                     has_back_reference);
 }
 
 template<class T>
-typename Nfa<T>::StateType Nfa<T>::GetStateType(int state) {
-  if (assertion_states_.contains(state)) {
-    return StateType::kAssertion;
+bool Nfa<T>::IsBackReference(int state) const {
+  auto [state_type, payload] = state_infos_[state];
+  if (state_type == StateType::kSpecialPattern) {
+    return special_pattern_nfas_[payload].IsBackReference();
   }
-  if (group_states_.contains(state)) {
-    return StateType::kGroup;
+  if (state_type == StateType::kRange) {
+    const auto &special_patterns = range_nfas_[payload].special_patterns_;
+    return std::any_of(special_patterns.cbegin(), special_patterns.cend(),
+                       [](const SpecialPatternNfa<T> &special_pattern) {
+                         return special_pattern.IsBackReference();
+                       });
   }
-  if (special_pattern_states_.contains(state)) {
-    return StateType::kSpecialPattern;
-  }
-  if (range_states_.contains(state)) {
-    return StateType::kRange;
-  }
-  return StateType::kCommon;
+  return false;
 }
 
 template<class T>
-std::set<std::basic_string<T>> GetDelim(const std::basic_string<T> &regex) {
-  using namespace std;
-
-  StrConstIt<T> begin = regex.cbegin(), end = regex.cend();
-  set<basic_string<T>> delim;
-  basic_string<T> token;
-
-  while (!(token = NextToken<T>(begin, end)).empty()) {
-    switch (GetRegexType(token)) {
-      case RegexPart::kChar:
-        delim.insert(token);
-        break;
-      case RegexPart::kGroup:
-        if (regex[1] == '?') {  // passive group
-          delim.merge(GetDelim(
-                  basic_string<T>(token.cbegin() + 3, token.cend() - 1)));
-        }
-        break;
-      default:
-        break;
-    }
+void Nfa<T>::GetDelim(const AstNode<T> *ast_head,
+                      std::set<std::basic_string_view<T>> &delim) {
+  if (!ast_head) {
+    return;
+  }
+  switch (ast_head->GetType()) {
+    case RegexPart::kChar:
+      delim.insert(ast_head->regex_);
+      break;
+    case RegexPart::kAnd:
+    case RegexPart::kAlternative:
+    case RegexPart::kQuantifier:
+    case RegexPart::kGroup:
+      GetDelim(ast_head->left_son_.get(), delim);
+      GetDelim(ast_head->right_son_.get(), delim);
+      break;
+    default:
+      break;
   }
-
-  return delim;
 }
 
 template<class T>
@@ -680,11 +1780,12 @@ Nfa<T> &Nfa<T>::operator+=(Nfa<T> &nfa) {
   if (char_ranges_.empty()) {
     char_ranges_.assign(nfa.char_ranges_.cbegin(), nfa.char_ranges_.cend());
   }
-  for (auto &pair:nfa.exchange_map_) {
-    exchange_map_[pair.first] = std::move(pair.second);
-  }
+  // States never collide in a compilation, so nodes are spliced without
+  // being copied.
+  exchange_map_.merge(nfa.exchange_map_);
   assertion_states_.merge(nfa.assertion_states_);
-  group_states_.merge(nfa.group_states_);
+  tag_states_.merge(nfa.tag_states_);
+  counter_states_.merge(nfa.counter_states_);
   special_pattern_states_.merge(nfa.special_pattern_states_);
   range_states_.merge(nfa.range_states_);
 
@@ -693,14 +1794,14 @@ Nfa<T> &Nfa<T>::operator+=(Nfa<T> &nfa) {
 
 template<class T>
 void
-Nfa<T>::CharRangesInit(const std::set<std::basic_string<T>> &delim,
+Nfa<T>::CharRangesInit(const std::set<std::basic_string_view<T>> &delim,
                        Encoding encoding) {
   using namespace std;
 
   set<unsigned int> char_ranges;
 
   // determine encode range
-  unsigned int max_encode;
+  unsigned int max_encode = 0x7f;
   switch (encoding) {
     case Encoding::kAscii:
       max_encode = 0x7f;
@@ -716,7 +1817,7 @@ Nfa<T>::CharRangesInit(const std::set<std::basic_string<T>> &delim,
 
   if (!delim.empty()) {
     for (auto &s:delim) {
-      if (s.size() == 1 && s != basic_string<T>(1, kFullStop)) {
+      if (s.size() == 1 && s[0] != kFullStop) {
         // single character
         // see single character as a range [s[0], s[0] + 1)
         AddCharRange(char_ranges, s[0]);
@@ -740,108 +1841,194 @@ inline void AddCharRange(std::set<unsigned int> &char_ranges,
 }
 
 template<class T>
-int Nfa<T>::GetCharLocation(int c) {
-  for (int i = 0; i < char_ranges_.size(); ++i) {
-    if (char_ranges_[i] > c) {
-      return i - 1;
-    }
+int Nfa<T>::GetCharLocation(int c) const {
+  auto it = std::upper_bound(char_ranges_.cbegin(), char_ranges_.cend(),
+                             static_cast<unsigned int>(c));
+  if (it == char_ranges_.cend()) {
+    return -1;
   }
-  return -1;
+  return it - char_ranges_.cbegin() - 1;
 }
 
 template<class T>
 Nfa<T>::Nfa(const std::basic_string<T> &regex) {
+  // The AST is destroyed before the arena.
+  std::pmr::monotonic_buffer_resource arena;
+  int group_num = 0;
+  auto ast_head = ParseRegex(regex, &arena, &group_num);
+  *this = Nfa(ast_head, group_num);
+}
+
+template<class T>
+Nfa<T>::Nfa(AstNodePtr<T> &ast_head, int group_num) {
   // initialize char_ranges_
-  auto delim = GetDelim(regex);
+  std::set<std::basic_string_view<T>> delim;
+  GetDelim(ast_head.get(), delim);
   if (typeid(T) == typeid(char)) {
     CharRangesInit(delim, Encoding::kAscii);
   } else {
     CharRangesInit(delim, Encoding::kUtf8);
   }
 
-  auto ast_head = ParseRegex(regex);
-  *this = Nfa(ast_head, char_ranges_);
+  int state_num = 0;
+  *this = Nfa(ast_head, char_ranges_, state_num);
+  group_num_ = group_num;
   if (!Empty()) {
     // add a new state as the accept state to prevent that accept state is a
     // functional state
-    NewState();
-    exchange_map_[accept_state_][kEmptyEdge].insert(i_);
-    accept_state_ = i_;
+    int accept_state = NewState(state_num);
+    exchange_map_[accept_state_][kEmptyEdge].insert(accept_state);
+    accept_state_ = accept_state;
+    Freeze();
+  }
+}
+
+template<class T>
+AstNodePtr<T> Nfa<T>::ParseRegex(const std::basic_string<T> &regex,
+                                 std::pmr::memory_resource *resource,
+                                 int *group_num) {
+  auto begin = regex.cbegin();
+  int group_index = 0;
+  auto ast_head = ParseAlternative(begin, regex.cend(), group_index,
+                                   resource);
+  if (begin != regex.cend()) {  // ) without (
+    return nullptr;
+  }
+  if (group_num) {
+    *group_num = group_index;
   }
+  return ast_head;
 }
 
 template<class T>
-AstNodePtr<T> Nfa<T>::ParseRegex(const std::basic_string<T> &regex) {
+AstNodePtr<T> Nfa<T>::ParseAlternative(StrConstIt<T> &begin,
+                                       StrConstIt<T> end, int &group_index,
+                                       std::pmr::memory_resource *resource) {
   using namespace std;
 
-  stack<AstNodePtr<T>> op_stack;
-  stack<AstNodePtr<T>> rpn_stack;
-  basic_string<T> lex;
-  auto cur_it = regex.cbegin(), end = regex.cend();
-  bool or_flag = true;  // whether the last lex is |
-  AstNodePtr<T> son;
+  auto ast_head = ParseSequence(begin, end, group_index, resource);
+  while (ast_head && begin != end && *begin == '|') {
+    ++begin;
+    auto right = ParseSequence(begin, end, group_index, resource);
+    if (!right) {
+      return nullptr;
+    }
+    auto alternative = MakeAstNode<T>(resource, RegexPart::kAlternative, {});
+    alternative->SetLeftSon(std::move(ast_head));
+    alternative->SetRightSon(std::move(right));
+    ast_head = std::move(alternative);
+  }
+  return ast_head;
+}
 
-  while (!(lex = NextToken<T>(cur_it, end)).empty()) {
-    switch (GetRegexType(lex)) {
-      case RegexPart::kAlternative:
-        or_flag = true;
-        if (!PushOr(op_stack, rpn_stack)) {
-          return nullptr;
-        }
-        break;
-      case RegexPart::kQuantifier:
-        if (!PushQuantifier(op_stack, rpn_stack, lex)) {
-          return nullptr;
-        }
-        break;
-      case RegexPart::kChar:
-        // We need to explicitly add & before a character when the last lex
-        // isn't |.
-        if (!or_flag && !PushAnd(op_stack, rpn_stack)) {
-          return nullptr;
-        }
-        rpn_stack.push(make_unique<AstNode<T>>(RegexPart::kChar, lex));
-        or_flag = false;
-        break;
-      case RegexPart::kGroup:
-        if (!or_flag && !PushAnd(op_stack, rpn_stack)) {
-          return nullptr;
-        }
-        // build AST for the sub-pattern in the group
-        if (lex[1] == '?') {  // passive group
-          // deal with it as a common regex
-          son = ParseRegex(basic_string<T>(lex.cbegin() + 3, lex.cend() - 1));
-          rpn_stack.push(std::move(son));
-        } else {  // group
-          rpn_stack.push(make_unique<AstNode<T>>(
-                  RegexPart::kGroup,
-                  basic_string<T>(lex.cbegin() + 1, lex.cend() - 1)));
-        }
-        or_flag = false;
-        break;
-      case RegexPart::kAssertion:
-        if (!or_flag && !PushAnd(op_stack, rpn_stack)) {
-          return nullptr;
-        }
-        rpn_stack.push(make_unique<AstNode<T>>(RegexPart::kAssertion, lex));
-        or_flag = false;
-        break;
-      case RegexPart::kAnd:
-        // kAnd should not exist here, so it is seen as an error.
-      case RegexPart::kError:  // skip the error token
-        break;
+template<class T>
+AstNodePtr<T> Nfa<T>::ParseSequence(StrConstIt<T> &begin, StrConstIt<T> end,
+                                    int &group_index,
+                                    std::pmr::memory_resource *resource) {
+  using namespace std;
+
+  AstNodePtr<T> ast_head;
+  while (begin != end && *begin != '|' && *begin != ')') {
+    AstNodePtr<T> atom;
+    if (*begin == '(') {
+      atom = ParseGroup(begin, end, group_index, resource);
+    } else {
+      auto token = NextToken<T>(begin, end);
+      if (token.empty()) {  // invalid token
+        return nullptr;
+      }
+      auto regex_type = GetRegexType(token);
+      // A quantifier should have something to repeat.
+      if (regex_type != RegexPart::kChar &&
+          regex_type != RegexPart::kAssertion) {
+        return nullptr;
+      }
+      atom = MakeAstNode(resource, regex_type, token);
+    }
+    if (!atom) {
+      return nullptr;
+    }
+
+    while (begin != end && (*begin == kAsterisk || *begin == kPlusSign ||
+                            *begin == kQuestionMark || *begin == '{')) {
+      auto token = NextToken<T>(begin, end);
+      pair<int, int> repeat_range;
+      if (!ParseQuantifier(token, repeat_range)) {
+        return nullptr;
+      }
+      if (token[0] == '{' && begin != end && *begin == kQuestionMark) {
+        ++begin;  // non-greedy
+      }
+      auto quantifier = MakeAstNode(resource, RegexPart::kQuantifier, token);
+      quantifier->repeat_range_ = repeat_range;
+      quantifier->SetLeftSon(std::move(atom));
+      atom = std::move(quantifier);
+    }
+
+    if (!ast_head) {
+      ast_head = std::move(atom);
+    } else {
+      auto and_node = MakeAstNode<T>(resource, RegexPart::kAnd, {});
+      and_node->SetLeftSon(std::move(ast_head));
+      and_node->SetRightSon(std::move(atom));
+      ast_head = std::move(and_node);
+    }
+  }
+  return ast_head;
+}
+
+template<class T>
+AstNodePtr<T> Nfa<T>::ParseGroup(StrConstIt<T> &begin, StrConstIt<T> end,
+                                 int &group_index,
+                                 std::pmr::memory_resource *resource) {
+  using namespace std;
+
+  ++begin;  // skip (
+  // (?: (?= (?! or empty for a group
+  basic_string_view<T> prefix;
+  if (begin != end && *begin == kQuestionMark) {
+    if (end - begin < 2 ||
+        (begin[1] != ':' && begin[1] != '=' && begin[1] != '!')) {
+      return nullptr;
     }
+    prefix = basic_string_view<T>(to_address(begin - 1), 3);
+    begin += 2;
   }
 
-  // empty op_stack
-  if (!PushOr(op_stack, rpn_stack) || rpn_stack.size() != 1) {
+  bool is_passive = !prefix.empty() && prefix[2] == ':';
+  bool is_lookahead = !prefix.empty() && !is_passive;
+  int index = group_index;
+  if (prefix.empty()) {
+    ++group_index;
+  }
+  // Groups in a lookahead are numbered from 0.
+  int lookahead_group_num = 0;
+  auto son = ParseAlternative(
+          begin, end, is_lookahead ? lookahead_group_num : group_index,
+          resource);
+  if (!son || begin == end) {  // empty sub-pattern or lack of )
     return nullptr;
   }
-  return std::move(rpn_stack.top());
+  ++begin;  // skip )
+  if (is_passive) {
+    return son;
+  }
+
+  AstNodePtr<T> ast_head;
+  if (is_lookahead) {
+    ast_head = MakeAstNode(resource, RegexPart::kAssertion, prefix);
+    ast_head->group_end_ = lookahead_group_num;
+  } else {
+    ast_head = MakeAstNode<T>(resource, RegexPart::kGroup, {});
+    ast_head->group_index_ = index;
+    ast_head->group_end_ = group_index;
+  }
+  ast_head->SetLeftSon(std::move(son));
+  return ast_head;
 }
 
 template<class T>
-RegexPart GetRegexType(const std::basic_string<T> &regex) {
+RegexPart GetRegexType(std::basic_string_view<T> regex) {
   switch (regex[0]) {
     // & is implicit so we don't have to think about it.
     case '|':
@@ -878,124 +2065,53 @@ RegexPart GetRegexType(const std::basic_string<T> &regex) {
 }
 
 template<class T>
-bool PushAnd(std::stack<AstNodePtr<T>> &op_stack,
-             std::stack<AstNodePtr<T>> &rpn_stack) {
-  using namespace std;
-
-  while (!op_stack.empty() &&
-         op_stack.top()->GetType() != RegexPart::kAlternative) {
-    if (op_stack.top()->GetType() == RegexPart::kAnd) {
-      if (rpn_stack.size() < 2) {
-        return false;
-      }
-      op_stack.top()->SetRightSon(std::move(rpn_stack.top()));
-      rpn_stack.pop();
-      op_stack.top()->SetLeftSon(std::move(rpn_stack.top()));
-      rpn_stack.pop();
-    } else {
-      if (rpn_stack.empty()) {
-        return false;
-      }
-      op_stack.top()->SetLeftSon(std::move(rpn_stack.top()));
-      rpn_stack.pop();
-    }
-    rpn_stack.push(std::move(op_stack.top()));
-    op_stack.pop();
-  }
-  op_stack.push(make_unique<AstNode<T>>(RegexPart::kAnd, basic_string<T>()));
-
-  return true;
-}
-
-template<class T>
-bool PushOr(std::stack<AstNodePtr<T>> &op_stack,
-            std::stack<AstNodePtr<T>> &rpn_stack) {
-  using namespace std;
-
-  while (!op_stack.empty()) {
-    if (op_stack.top()->GetType() == RegexPart::kAnd ||
-        op_stack.top()->GetType() == RegexPart::kAlternative) {
-      if (rpn_stack.size() < 2) {
-        return false;
-      }
-      op_stack.top()->SetRightSon(std::move(rpn_stack.top()));
-      rpn_stack.pop();
-      op_stack.top()->SetLeftSon(std::move(rpn_stack.top()));
-      rpn_stack.pop();
-    } else {
-      if (rpn_stack.empty()) {
-        return false;
-      }
-      op_stack.top()->SetLeftSon(std::move(rpn_stack.top()));
-      rpn_stack.pop();
-    }
-    rpn_stack.push(std::move(op_stack.top()));
-    op_stack.pop();
-  }
-  op_stack.push(
-          make_unique<AstNode<T>>(RegexPart::kAlternative, basic_string<T>()));
-
-  return true;
-}
-
-template<class T>
-bool PushQuantifier(std::stack<AstNodePtr<T>> &op_stack,
-                    std::stack<AstNodePtr<T>> &rpn_stack,
-                    const std::basic_string<T> &regex) {
-  using namespace std;
-
-  while (!op_stack.empty() &&
-         op_stack.top()->GetType() != RegexPart::kAlternative &&
-         op_stack.top()->GetType() != RegexPart::kAnd) {
-    if (rpn_stack.empty()) {
-      return false;
-    }
-    op_stack.top()->SetLeftSon(std::move(rpn_stack.top()));
-    rpn_stack.pop();
-    rpn_stack.push(std::move(op_stack.top()));
-    op_stack.pop();
-  }
-  op_stack.push(make_unique<AstNode<T>>(RegexPart::kQuantifier, regex));
-
-  return true;
+AstNodePtr<T> MakeAstNode(std::pmr::memory_resource *resource,
+                          RegexPart regex_type,
+                          std::basic_string_view<T> regex) {
+  void *node = resource->allocate(sizeof(AstNode<T>), alignof(AstNode<T>));
+  return AstNodePtr<T>(new(node) AstNode<T>(regex_type, regex), {resource});
 }
 
 template<class T>
 Nfa<T>::Nfa(AstNodePtr<T> &ast_head,
-            const std::vector<unsigned int> &char_ranges) {
+            const std::vector<unsigned int> &char_ranges, int &state_num) {
   if (ast_head) {
     switch (ast_head->regex_type_) {
       case RegexPart::kChar:
-        *this = NfaFactory<T>::MakeCharacterNfa(ast_head->regex_, char_ranges);
+        *this = NfaFactory<T>::MakeCharacterNfa(ast_head->regex_, char_ranges,
+                                                state_num);
         break;
       case RegexPart::kAlternative:
-        *this = NfaFactory<T>::MakeAlternativeNfa(
-                Nfa(ast_head->left_son_, char_ranges),
-                Nfa(ast_head->right_son_, char_ranges));
-        break;
-      case RegexPart::kAnd:
-        *this = NfaFactory<T>::MakeAndNfa(
-                Nfa(ast_head->left_son_, char_ranges),
-                Nfa(ast_head->right_son_, char_ranges));
+      case RegexPart::kAnd: {
+        // Empty edges are tried in ascending order of their states, so the
+        // left son is built first to be tried first when paths tie.
+        Nfa left_nfa(ast_head->left_son_, char_ranges, state_num);
+        Nfa right_nfa(ast_head->right_son_, char_ranges, state_num);
+        if (ast_head->regex_type_ == RegexPart::kAlternative) {
+          *this = NfaFactory<T>::MakeAlternativeNfa(
+                  std::move(left_nfa), std::move(right_nfa), state_num);
+        } else {
+          *this = NfaFactory<T>::MakeAndNfa(std::move(left_nfa),
+                                            std::move(right_nfa));
+        }
         break;
+      }
       case RegexPart::kQuantifier:
         *this = NfaFactory<T>::MakeQuantifierNfa(
-                ast_head->regex_, ast_head->left_son_, char_ranges);
+                ast_head->repeat_range_, ast_head->left_son_, char_ranges,
+                state_num);
         break;
       case RegexPart::kGroup:
-        char_ranges_.assign(char_ranges.cbegin(), char_ranges.cend());
-        NewState();
-        begin_state_ = i_;
-        accept_state_ = i_;
-        group_states_.insert({begin_state_, GroupNfa<T>(ast_head->regex_)});
+        *this = NfaFactory<T>::MakeGroupNfa(ast_head, char_ranges, state_num);
         break;
       case RegexPart::kAssertion:
         char_ranges_.assign(char_ranges.cbegin(), char_ranges.cend());
-        NewState();
-        begin_state_ = i_;
-        accept_state_ = i_;
+        begin_state_ = NewState(state_num);
+        accept_state_ = begin_state_;
         assertion_states_.insert(
-                {begin_state_, AssertionNfa<T>(ast_head->regex_)});
+                {begin_state_,
+                 AssertionNfa<T>(ast_head->regex_, ast_head->left_son_,
+                                 ast_head->group_end_)});
         break;
       case RegexPart::kError:
         break;
@@ -1004,46 +2120,152 @@ Nfa<T>::Nfa(AstNodePtr<T> &ast_head,
 }
 
 template<class T>
-void Nfa<T>::NewState() {
+int Nfa<T>::NewState(int &state_num) {
+  exchange_map_.try_emplace(state_num);
+  return state_num++;
+}
+
+template<class T>
+void Nfa<T>::Freeze(std::vector<int> *states) {
   using namespace std;
 
-  vector<set<int>> edges_vec;
-  edges_vec.reserve(char_ranges_.size());
-  for (int i = 0; i < char_ranges_.size(); ++i) {
-    edges_vec.emplace_back(set<int>());
+  map<int, int> new_ids;
+  for (const auto &pair:exchange_map_) {
+    new_ids.emplace(pair.first, new_ids.size());
+  }
+
+  edge_offsets_.push_back(0);
+  empty_edge_offsets_.push_back(0);
+  for (const auto &pair:exchange_map_) {
+    for (const auto &[char_range, next_states]:pair.second) {
+      for (auto next_state:next_states) {
+        if (char_range == kEmptyEdge) {
+          empty_edges_.push_back(new_ids[next_state]);
+        } else {
+          edges_.push_back({char_range, new_ids[next_state]});
+        }
+      }
+    }
+    edge_offsets_.push_back(edges_.size());
+    empty_edge_offsets_.push_back(empty_edges_.size());
+  }
+  exchange_map_.clear();
+
+  // The last range begins after the end of the encoding.
+  int range_num = static_cast<int>(char_ranges_.size());
+  vector<int> locations(range_num);
+  for (int i = 0; i < range_num; ++i) {
+    locations[i] = i + 1 < range_num ? i : -1;
+  }
+  char_locations_ = CharClassMap<T>(char_ranges_, locations);
+
+  state_infos_.assign(new_ids.size(), {StateType::kCommon, -1});
+  auto pack = [this, &new_ids](auto &func_states, auto &func_nfas,
+                               StateType state_type) {
+    func_nfas.reserve(func_states.size());
+    for (auto &pair:func_states) {
+      state_infos_[new_ids[pair.first]] = {
+              state_type, static_cast<int>(func_nfas.size())};
+      func_nfas.push_back(std::move(pair.second));
+    }
+    func_states.clear();
+  };
+  pack(assertion_states_, assertion_nfas_, StateType::kAssertion);
+  pack(tag_states_, tags_, StateType::kTag);
+  pack(counter_states_, counters_, StateType::kCounter);
+  // A counter is indexed by its begin state, which comes before its end
+  // state, so counters are numbered in the order of their begin states.
+  map<int, int> counter_ids;
+  for (auto &counter:counters_) {
+    counter.index = counter_ids.try_emplace(
+            counter.index, static_cast<int>(counter_ids.size()))
+            .first->second;
+  }
+  counter_num_ = static_cast<int>(counter_ids.size());
+  pack(special_pattern_states_, special_pattern_nfas_,
+       StateType::kSpecialPattern);
+  pack(range_states_, range_nfas_, StateType::kRange);
+
+  begin_state_ = new_ids[begin_state_];
+  accept_state_ = new_ids[accept_state_];
+  if (states != nullptr) {
+    for (auto &state:*states) {
+      if (state >= 0) {
+        state = new_ids[state];
+      }
+    }
+  }
+
+  // Visit states like AddThread. visited[state] is the last closure
+  // visiting state.
+  int state_num = GetStateNum();
+  vector<int> visited(state_num, -1);
+  closure_offsets_.push_back(0);
+  for (int state = 0; state < state_num; ++state) {
+    vector<int> closure;
+    stack<int> state_stack;
+    state_stack.push(state);
+    while (!state_stack.empty()) {
+      int cur_state = state_stack.top();
+      state_stack.pop();
+      if (visited[cur_state] == state) {
+        continue;
+      }
+      visited[cur_state] = state;
+
+      // Assertions, tags and counters depend on the thread, and a relaxed
+      // run passes through back-references, so closures reaching them are
+      // computed when they are used.
+      auto state_type = GetStateType(cur_state);
+      if (state_type == StateType::kAssertion ||
+          state_type == StateType::kTag ||
+          state_type == StateType::kCounter || IsBackReference(cur_state) ||
+          closure.size() == kMaxClosureSize) {
+        closure.clear();
+        break;
+      }
+      closure.push_back(cur_state);
+      if (state_type == StateType::kCommon) {
+        auto empty_edges = GetEmptyEdges(cur_state);
+        for (auto it = empty_edges.rbegin(); it != empty_edges.rend(); ++it) {
+          state_stack.push(*it);
+        }
+      }
+    }
+    closures_.insert(closures_.end(), closure.cbegin(), closure.cend());
+    closure_offsets_.push_back(closures_.size());
   }
-  exchange_map_.template emplace(++i_, edges_vec);
 }
 
 template<class T>
-Nfa<T> NfaFactory<T>::MakeCharacterNfa(const std::basic_string<T> &characters,
-                                       const std::vector<unsigned int> &char_ranges) {
+Nfa<T> NfaFactory<T>::MakeCharacterNfa(std::basic_string_view<T> characters,
+                                       const std::vector<unsigned int> &char_ranges,
+                                       int &state_num) {
   using namespace std;
 
   Nfa<T> nfa;
   nfa.char_ranges_.assign(char_ranges.cbegin(), char_ranges.cend());
 
-  nfa.NewState();
-  nfa.begin_state_ = Nfa<T>::i_;
+  nfa.begin_state_ = nfa.NewState(state_num);
 
   if (characters.size() == 1) {
-    if (characters == basic_string<T>(1, kFullStop)) {
+    if (characters[0] == kFullStop) {
       nfa.accept_state_ = nfa.begin_state_;
       nfa.special_pattern_states_.emplace(
-              nfa.begin_state_, SpecialPatternNfa(characters));
+              nfa.begin_state_, SpecialPatternNfa(basic_string<T>(characters)));
     } else {  // single character
-      nfa.NewState();
-      nfa.accept_state_ = Nfa<T>::i_;
+      nfa.accept_state_ = nfa.NewState(state_num);
       nfa.exchange_map_[nfa.begin_state_][nfa.GetCharLocation(
               characters[0])].insert(nfa.accept_state_);
     }
   } else if (characters[0] == '[') {  // [...]
     nfa.accept_state_ = nfa.begin_state_;
-    nfa.range_states_.emplace(nfa.begin_state_, RangeNfa(characters));
+    nfa.range_states_.emplace(nfa.begin_state_,
+                              RangeNfa(basic_string<T>(characters)));
   } else {  // special pattern characters
     nfa.accept_state_ = nfa.begin_state_;
     nfa.special_pattern_states_.emplace(
-            nfa.begin_state_, SpecialPatternNfa(characters));
+            nfa.begin_state_, SpecialPatternNfa(basic_string<T>(characters)));
   }
 
   return nfa;
@@ -1051,88 +2273,244 @@ Nfa<T> NfaFactory<T>::MakeCharacterNfa(const std::basic_string<T> &characters,
 
 template<class T>
 Nfa<T>
-NfaFactory<T>::MakeAlternativeNfa(Nfa<T> left_nfa, Nfa<T> right_nfa) {
-  Nfa<T> nfa;
+NfaFactory<T>::MakeAlternativeNfa(Nfa<T> left_nfa, Nfa<T> right_nfa,
+                                  int &state_num) {
+  int left_begin = left_nfa.begin_state_;
+  int left_accept = left_nfa.accept_state_;
+  int right_begin = right_nfa.begin_state_;
+  int right_accept = right_nfa.accept_state_;
+  auto nfa = Merge(left_nfa, right_nfa);
 
-  nfa += left_nfa;
-  nfa += right_nfa;
   // Add empty edges from new begin state to left_nfa's and right_nfa's begin
   // state.
-  nfa.NewState();
-  nfa.begin_state_ = Nfa<T>::i_;
-  nfa.exchange_map_[nfa.begin_state_][Nfa<T>::kEmptyEdge].insert(
-          left_nfa.begin_state_);
-  nfa.exchange_map_[nfa.begin_state_][Nfa<T>::kEmptyEdge].insert(
-          right_nfa.begin_state_);
+  nfa.begin_state_ = nfa.NewState(state_num);
+  nfa.exchange_map_[nfa.begin_state_][Nfa<T>::kEmptyEdge].insert(left_begin);
+  nfa.exchange_map_[nfa.begin_state_][Nfa<T>::kEmptyEdge].insert(right_begin);
   // Add empty edges from left_nfa's and right_nfa's accept states to the new
   // accept state.
-  nfa.NewState();
-  nfa.exchange_map_[left_nfa.accept_state_][Nfa<T>::kEmptyEdge].insert(
-          Nfa<T>::i_);
-  nfa.exchange_map_[right_nfa.accept_state_][Nfa<T>::kEmptyEdge].insert(
-          Nfa<T>::i_);
-  nfa.accept_state_ = Nfa<T>::i_;
+  nfa.accept_state_ = nfa.NewState(state_num);
+  nfa.exchange_map_[left_accept][Nfa<T>::kEmptyEdge].insert(
+          nfa.accept_state_);
+  nfa.exchange_map_[right_accept][Nfa<T>::kEmptyEdge].insert(
+          nfa.accept_state_);
 
   return nfa;
 }
 
 template<class T>
 Nfa<T> NfaFactory<T>::MakeAndNfa(Nfa<T> left_nfa, Nfa<T> right_nfa) {
+  int left_begin = left_nfa.begin_state_;
+  int left_accept = left_nfa.accept_state_;
+  int right_begin = right_nfa.begin_state_;
+  int right_accept = right_nfa.accept_state_;
+  auto nfa = Merge(left_nfa, right_nfa);
+
+  nfa.begin_state_ = left_begin;
+  nfa.accept_state_ = right_accept;
+  // Add empty edges from left_nfa's accept state to right_nfa's begin state.
+  nfa.exchange_map_[left_accept][Nfa<T>::kEmptyEdge].insert(right_begin);
+
+  return nfa;
+}
+
+template<class T>
+Nfa<T>
+NfaFactory<T>::MakeGroupNfa(AstNodePtr<T> &group,
+                            const std::vector<unsigned int> &char_ranges,
+                            int &state_num) {
+  auto make_tag = [&char_ranges, &state_num](typename Nfa<T>::Tag tag) {
+    Nfa<T> nfa;
+    nfa.char_ranges_.assign(char_ranges.cbegin(), char_ranges.cend());
+    nfa.begin_state_ = nfa.NewState(state_num);
+    nfa.accept_state_ = nfa.begin_state_;
+    nfa.tag_states_.insert({nfa.begin_state_, tag});
+    return nfa;
+  };
+
+  // States are numbered in order, so a group is built the same way on
+  // every compiler.
+  auto begin_nfa = make_tag({group->group_index_, true, group->group_end_});
+  Nfa<T> sub_nfa(group->left_son_, char_ranges, state_num);
+  if (sub_nfa.Empty()) {
+    return sub_nfa;
+  }
+  auto end_nfa = make_tag({group->group_index_, false, group->group_end_});
+  return MakeAndNfa(MakeAndNfa(std::move(begin_nfa), std::move(sub_nfa)),
+                    std::move(end_nfa));
+}
+
+template<class T>
+Nfa<T>
+NfaFactory<T>::MakeSetNfa(const std::vector<std::basic_string<T>> &regexes,
+                          std::vector<int> &accept_states) {
+  using namespace std;
+
+  // All regexes have to share char ranges, so they are parsed first. Their
+  // ASTs live in a single arena released when the set is built.
+  pmr::monotonic_buffer_resource arena;
+  vector<AstNodePtr<T>> asts;
+  set<basic_string_view<T>> delim;
+  for (const auto &regex:regexes) {
+    asts.push_back(Nfa<T>::ParseRegex(regex, &arena));
+    InlineGroups(asts.back(), delim);
+  }
+
   Nfa<T> nfa;
+  if (typeid(T) == typeid(char)) {
+    nfa.CharRangesInit(delim, Encoding::kAscii);
+  } else {
+    nfa.CharRangesInit(delim, Encoding::kUtf8);
+  }
 
-  nfa += left_nfa;
-  nfa += right_nfa;
-  nfa.begin_state_ = left_nfa.begin_state_;
-  nfa.accept_state_ = right_nfa.accept_state_;
-  // Add empty edges from left_nfa's accept state to right_nfa's begin state.
-  nfa.exchange_map_[left_nfa.accept_state_][Nfa<T>::kEmptyEdge].insert(
-          right_nfa.begin_state_);
+  accept_states.assign(regexes.size(), -1);
+  int state_num = 0;
+  for (std::size_t i = 0; i < asts.size(); ++i) {
+    if (!asts[i]) {
+      continue;
+    }
+    Nfa<T> regex_nfa(asts[i], nfa.char_ranges_, state_num);
+    if (regex_nfa.Empty() || !regex_nfa.assertion_states_.empty() ||
+        !regex_nfa.tag_states_.empty() ||
+        !regex_nfa.counter_states_.empty() || regex_nfa.HasBackReference()) {
+      continue;
+    }
+    // The accept state may be a functional state, so a new one is added.
+    int accept_state = regex_nfa.NewState(state_num);
+    regex_nfa.exchange_map_[regex_nfa.accept_state_][Nfa<T>::kEmptyEdge]
+            .insert(accept_state);
+    regex_nfa.accept_state_ = accept_state;
+    accept_states[i] = accept_state;
+
+    if (nfa.Empty()) {
+      nfa = std::move(regex_nfa);
+    } else {
+      nfa = MakeAlternativeNfa(std::move(nfa), std::move(regex_nfa),
+                               state_num);
+    }
+  }
 
+  if (!nfa.Empty()) {
+    nfa.Freeze(&accept_states);
+  }
   return nfa;
 }
 
+template<class T>
+void NfaFactory<T>::InlineGroups(AstNodePtr<T> &ast_head,
+                                 std::set<std::basic_string_view<T>> &delim) {
+  if (!ast_head) {
+    return;
+  }
+  if (ast_head->regex_type_ == RegexPart::kGroup) {
+    auto son = std::move(ast_head->left_son_);
+    ast_head = std::move(son);
+    InlineGroups(ast_head, delim);
+    return;
+  }
+  if (ast_head->regex_type_ == RegexPart::kChar) {
+    delim.insert(ast_head->regex_);
+  }
+  InlineGroups(ast_head->left_son_, delim);
+  InlineGroups(ast_head->right_son_, delim);
+}
+
+template<class T>
+Nfa<T> NfaFactory<T>::Merge(Nfa<T> &left_nfa, Nfa<T> &right_nfa) {
+  if (left_nfa.exchange_map_.size() < right_nfa.exchange_map_.size()) {
+    right_nfa += left_nfa;
+    return std::move(right_nfa);
+  }
+  left_nfa += right_nfa;
+  return std::move(left_nfa);
+}
+
 template<class T>
 Nfa<T>
-NfaFactory<T>::MakeQuantifierNfa(const std::basic_string<T> &quantifier,
+NfaFactory<T>::MakeQuantifierNfa(std::pair<int, int> repeat_range,
                                  AstNodePtr<T> &left,
-                                 const std::vector<unsigned int> &char_ranges) {
+                                 const std::vector<unsigned int> &char_ranges,
+                                 int &state_num) {
+  using namespace std;
+
   Nfa<T> nfa;
   nfa.char_ranges_.assign(char_ranges.cbegin(), char_ranges.cend());
 
-  auto repeat_range = ParseQuantifier(quantifier);
+  // copies of left when it is unrolled
+  int repeat_times = repeat_range.second == INT_MAX ? repeat_range.first
+                                                    : repeat_range.second;
+
+  if (repeat_times > 1 && repeat_range.first <= repeat_range.second) {
+    Nfa<T> left_nfa(left, nfa.char_ranges_, state_num);
+    long long state_count = left_nfa.exchange_map_.size();
+    if (!left_nfa.Empty() && state_count * repeat_times > kMaxRepeatStates) {
+      // x is built once between a begin counter and an end counter. Like
+      // an unrolled repetition, the exit is added after x, so it is tried
+      // after going on with the repetition.
+      int begin_state = left_nfa.NewState(state_num);
+      int end_state = left_nfa.NewState(state_num);
+      int exit_state = left_nfa.NewState(state_num);
+      auto &exchange_map = left_nfa.exchange_map_;
+      exchange_map[begin_state][Nfa<T>::kEmptyEdge].insert(
+              left_nfa.begin_state_);
+      if (repeat_range.first == 0) {
+        exchange_map[begin_state][Nfa<T>::kEmptyEdge].insert(exit_state);
+      }
+      exchange_map[left_nfa.accept_state_][Nfa<T>::kEmptyEdge].insert(
+              end_state);
+      exchange_map[end_state][Nfa<T>::kEmptyEdge].insert(
+              left_nfa.begin_state_);
+      exchange_map[end_state][Nfa<T>::kEmptyEdge].insert(exit_state);
+      // Until Freeze numbers counters, a counter is indexed by its begin
+      // state.
+      left_nfa.counter_states_.insert(
+              {begin_state, {begin_state, true, repeat_range.first,
+                             repeat_range.second}});
+      left_nfa.counter_states_.insert(
+              {end_state, {begin_state, false, repeat_range.first,
+                           repeat_range.second}});
+      left_nfa.begin_state_ = begin_state;
+      left_nfa.accept_state_ = exit_state;
+      return left_nfa;
+    }
+  }
 
-  nfa.NewState();
-  nfa.begin_state_ = Nfa<T>::i_;
-  nfa.accept_state_ = Nfa<T>::i_;
+  nfa.begin_state_ = nfa.NewState(state_num);
+  nfa.accept_state_ = nfa.begin_state_;
 
+  // The NFA built so far is moved, so every copy of left is only merged
+  // once and the repetition is built in O(n log n) time.
   int i = 1;
   for (; i < repeat_range.first; ++i) {
-    Nfa<T> left_nfa(left, nfa.char_ranges_);
+    Nfa<T> left_nfa(left, nfa.char_ranges_, state_num);
     // connect left_nfa to the end of the current nfa
-    nfa = MakeAndNfa(nfa, left_nfa);
+    nfa = MakeAndNfa(std::move(nfa), std::move(left_nfa));
   }
 
-  nfa.NewState();
-  int final_accept_state = Nfa<T>::i_;
-
+  // states with empty edges to the final accept state
+  vector<int> exit_states;
   if (repeat_range.second == INT_MAX) {
-    Nfa<T> left_nfa(left, nfa.char_ranges_);
+    Nfa<T> left_nfa(left, nfa.char_ranges_, state_num);
+    int left_begin = left_nfa.begin_state_;
     // connect left_nfa to the end of the current nfa
-    nfa = MakeAndNfa(nfa, left_nfa);
-    nfa.exchange_map_[nfa.accept_state_][Nfa<T>::kEmptyEdge].insert(
-            left_nfa.begin_state_);
+    nfa = MakeAndNfa(std::move(nfa), std::move(left_nfa));
     nfa.exchange_map_[nfa.accept_state_][Nfa<T>::kEmptyEdge].insert(
-            final_accept_state);
+            left_begin);
+    exit_states.push_back(nfa.accept_state_);
   } else {
     for (; i <= repeat_range.second; ++i) {
-      Nfa<T> left_nfa(left, nfa.char_ranges_);
+      Nfa<T> left_nfa(left, nfa.char_ranges_, state_num);
       // connect left_nfa to the end of the current nfa
-      nfa = MakeAndNfa(nfa, left_nfa);
-      nfa.exchange_map_[left_nfa.accept_state_][Nfa<T>::kEmptyEdge].insert(
-              final_accept_state);
+      nfa = MakeAndNfa(std::move(nfa), std::move(left_nfa));
+      exit_states.push_back(nfa.accept_state_);
     }
   }
 
+  // The final accept state is added after all copies of left, so leaving
+  // the repetition is tried after going on with it when paths tie.
+  int final_accept_state = nfa.NewState(state_num);
+  for (auto state:exit_states) {
+    nfa.exchange_map_[state][Nfa<T>::kEmptyEdge].insert(final_accept_state);
+  }
   nfa.accept_state_ = final_accept_state;
 
   if (repeat_range.first == 0) {
@@ -1145,54 +2523,70 @@ NfaFactory<T>::MakeQuantifierNfa(const std::basic_string<T> &quantifier,
 }
 
 template<class T>
-std::pair<int, int>
-NfaFactory<T>::ParseQuantifier(const std::basic_string<T> &quantifier) {
+bool ParseQuantifier(std::basic_string_view<T> quantifier,
+                     std::pair<int, int> &repeat_range) {
   using namespace std;
 
-  pair<int, int> repeat_range;
-
-  // initialize 'repeat_range'
-  if (quantifier == basic_string<T>(1, kAsterisk)) {
-    repeat_range.first = 0;
-    repeat_range.second = INT_MAX;
-  } else if (quantifier == basic_string<T>(1, kPlusSign)) {
-    repeat_range.first = 1;
-    repeat_range.second = INT_MAX;
-  } else if (quantifier == basic_string<T>(1, kQuestionMark)) {
-    repeat_range.first = 0;
-    repeat_range.second = 1;
-  } else {  // {...}
-    // extract first number
-    auto beg_it = find_if(quantifier.cbegin(), quantifier.cend(),
-                          [](auto c) { return isdigit(c); });
-    auto end_it = find_if_not(beg_it, quantifier.cend(),
-                              [](auto c) { return isdigit(c); });
-    repeat_range.first = stoi(basic_string<T>(beg_it, end_it));
-
-    auto comma = quantifier.find(',');
-    if (comma == basic_string<T>::npos) {  // exact times
-      repeat_range.second = repeat_range.first;
-    } else {  // {min,max} or {min,}
-      // extract first number
-      beg_it = find_if(end_it, quantifier.cend(),
-                       [](auto c) { return isdigit(c); });
-      end_it = find_if_not(beg_it, quantifier.cend(),
-                           [](auto c) { return isdigit(c); });
-
-      if (beg_it == end_it) {  // {min,}
-        repeat_range.second = INT_MAX;
-      } else {  // {min,max}
-        repeat_range.second = stoi(basic_string<T>(beg_it, end_it));
+  if (quantifier.empty()) {
+    return false;
+  }
+  switch (quantifier[0]) {
+    case kAsterisk:
+      repeat_range = {0, INT_MAX};
+      return true;
+    case kPlusSign:
+      repeat_range = {1, INT_MAX};
+      return true;
+    case kQuestionMark:
+      repeat_range = {0, 1};
+      return true;
+    default:  // {...}
+      if (quantifier.size() < 3 || quantifier[0] != '{' ||
+          quantifier.back() != '}') {
+        return false;
       }
-    }
+      break;
   }
 
-  return repeat_range;
+  // Read a number from it. It returns -1 if there is no number or the
+  // number is too large.
+  auto it = quantifier.cbegin() + 1;
+  auto read_number = [&it, &quantifier]() {
+    int number = -1;
+    for (; it != quantifier.cend() && *it >= '0' && *it <= '9'; ++it) {
+      int digit = *it - '0';
+      if (number > (INT_MAX - digit) / 10) {
+        return -1;
+      }
+      number = max(number, 0) * 10 + digit;
+    }
+    return number;
+  };
+
+  repeat_range.first = read_number();
+  if (repeat_range.first == -1) {
+    return false;
+  }
+  if (*it == ',') {
+    ++it;
+    if (*it == '}') {  // {min,}
+      repeat_range.second = INT_MAX;
+    } else {  // {min,max}
+      repeat_range.second = read_number();
+      if (repeat_range.second < repeat_range.first) {
+        return false;
+      }
+    }
+  } else {  // exact times
+    repeat_range.second = repeat_range.first;
+  }
+  return it + 1 == quantifier.cend();
 }
 
 template<class T>
 bool AssertionNfa<T>::IsSuccess(StrConstIt<T> str_begin, StrConstIt<T> str_end,
-                                StrConstIt<T> begin) {
+                                StrConstIt<T> begin,
+                                MatchScratch<T> &scratch) const {
   switch (type_) {
     case AssertionType::kLineBegin:
       if (begin == str_begin || IsLineTerminator<T>(begin - 1)) {
@@ -1231,9 +2625,11 @@ bool AssertionNfa<T>::IsSuccess(StrConstIt<T> str_begin, StrConstIt<T> str_end,
       }
       break;
     case AssertionType::kPositiveLookahead:
-      return nfa_.NextMatch(begin, str_end) != nullptr;
+      return nfa_.NextMatch(begin, str_end, scratch.LookaheadScratch()) !=
+             nullptr;
     case AssertionType::kNegativeLookahead:
-      return nfa_.NextMatch(begin, str_end) == nullptr;
+      return nfa_.NextMatch(begin, str_end, scratch.LookaheadScratch()) ==
+             nullptr;
   }
   return false;
 }
@@ -1252,31 +2648,99 @@ bool IsWord(StrConstIt<T> it) {
 }
 
 template<class T>
-std::set<StrConstIt<T>>
-GroupNfa<T>::NextMatch(StrConstIt<T> begin, StrConstIt<T> str_end) {
+SpecialPatternNfa<T>::SpecialPatternNfa(std::basic_string<T> characters)
+        : characters_(std::move(characters)) {
   using namespace std;
 
-  set<StrConstIt<T>> end_its;
-
-  // We don't use begin == str_end since an empty string may be captured.
-  if (begin > str_end) {
-    return end_its;
+  if (IsBackReference()) {
+    for (auto it = characters_.cbegin() + 1; it != characters_.cend(); ++it) {
+      // Larger indexes never refer to a group.
+      if (back_reference_ < INT_MAX / 10) {
+        back_reference_ = back_reference_ * 10 + (*it - '0');
+      }
+    }
+    return;
   }
 
-  vector<ReachableStatesMap<T>> state_vec = this->StateRoute(begin, str_end);
-  auto it = state_vec.cbegin();
+  auto add_digits = [this]() {
+    char_set_.Add('0', '9');
+  };
+  auto add_spaces = [this]() {
+    char_set_.Add('\t', '\r');  // \t \n \v \f \r
+    char_set_.Add(' ', ' ');
+  };
+  auto add_words = [this, &add_digits]() {
+    add_digits();
+    char_set_.Add('A', 'Z');
+    char_set_.Add('a', 'z');
+  };
 
-  // find the longest match
-  while (it != state_vec.cend()) {
-    for (const auto &cur_state:*it) {
-      if (cur_state.first.first == this->accept_state_) {
-        end_its.insert(cur_state.first.second);
-      }
-    }
-    it++;
+  if (characters_.size() == 1) {  // . matches everything but new lines
+    char_set_.Add('\n', '\n');
+    char_set_.Add('\r', '\r');
+    char_set_.Invert();
+    return;
+  }
+  switch (characters_[1]) {
+    case 'd':  // digit
+    case 'D':
+      add_digits();
+      break;
+    case 's':  // whitespace
+    case 'S':
+      add_spaces();
+      break;
+    case 'w':  // word
+    case 'W':
+      add_words();
+      break;
+    case 't':
+      char_set_.Add('\t', '\t');
+      break;
+    case 'n':
+      char_set_.Add('\n', '\n');
+      break;
+    case 'v':
+      char_set_.Add('\v', '\v');
+      break;
+    case 'f':
+      char_set_.Add('\f', '\f');
+      break;
+    case '0':
+      char_set_.Add('\0', '\0');
+      break;
+    default:  // \\^ \\$ \\\\ \\. \\* \\+ \\? \\( \\) \\[ \\] \\{ \\} \\|
+      char_set_.Add(CodePoint(characters_[1]), CodePoint(characters_[1]));
+      break;
+  }
+  if (characters_[1] == 'D' || characters_[1] == 'S' ||
+      characters_[1] == 'W') {
+    char_set_.Invert();
+  }
+  // TODO(dxy): \\c \\x \\u
+}
+
+template<class T>
+StrConstIt<T>
+SpecialPatternNfa<T>::NextMatch(StrConstIt<T> begin, StrConstIt<T> str_end,
+                                std::span<const StrConstIt<T>> slots) const {
+  if (begin == str_end) {
+    return begin;
+  }
+  if (back_reference_ == 0) {
+    return char_set_.Contains(*begin) ? begin + 1 : begin;
   }
 
-  return end_its;
+  if (back_reference_ > static_cast<int>(slots.size() / 2)) {  // no such group
+    return begin;
+  }
+  auto sub_match_begin = slots[2 * back_reference_ - 2];
+  auto sub_match_end = slots[2 * back_reference_ - 1];
+  if (sub_match_end - sub_match_begin > str_end - begin ||
+      !std::equal(sub_match_begin, sub_match_end, begin)) {
+    return begin;
+  }
+  return begin + (sub_match_end - sub_match_begin);
 }
 
 template<class T>
@@ -1302,60 +2766,52 @@ RangeNfa<T>::RangeNfa(const std::basic_string<T> &regex) {
       special_patterns_.push_back(
               SpecialPatternNfa<T>(basic_string<T>(begin, begin + 1)));
       begin++;
-    } else {
-      if (begin + 1 < end && *(begin + 1) == '-') {  // range
-        if (begin + 2 < end) {
-          ranges_.emplace(*begin, *(begin + 2));
-          begin += 3;
-        }
-      } else {  // single character
-        ranges_.emplace(*begin, *(begin + 1));
-        begin++;
-      }
+    } else if (begin + 2 < end && *(begin + 1) == '-') {  // range
+      ranges_.emplace_back(CodePoint(*begin), CodePoint(*(begin + 2)));
+      begin += 3;
+    } else {  // single character, including - at the end
+      ranges_.emplace_back(CodePoint(*begin), CodePoint(*begin));
+      begin++;
+    }
+  }
+
+  for (const auto &[first, last]:ranges_) {
+    char_set_.Add(first, last);
+  }
+  for (const auto &special_pattern:special_patterns_) {
+    has_back_reference_ |= special_pattern.IsBackReference();
+  }
+  if (!has_back_reference_) {
+    for (const auto &special_pattern:special_patterns_) {
+      char_set_.Add(special_pattern.GetCharSet());
+    }
+    if (except_) {
+      char_set_.Invert();
     }
   }
 }
 
 template<class T>
 StrConstIt<T>
-RangeNfa<T>::NextMatch(const State<T> &state, StrConstIt<T> str_end) {
-  auto begin = state.first.second;
-
+RangeNfa<T>::NextMatch(StrConstIt<T> begin, StrConstIt<T> str_end,
+                       std::span<const StrConstIt<T>> slots) const {
   if (begin == str_end) {  // no character to match
     return begin;
   }
+  if (!has_back_reference_) {
+    return char_set_.Contains(*begin) ? begin + 1 : begin;
+  }
 
-  if (except_) {
-    for (auto &range:ranges_) {
-      if (*begin >= range.first && *begin <= range.second) {
-        return begin;
-      }
-    }
-
-    for (auto special_pattern:special_patterns_) {
-      begin = special_pattern.NextMatch(state, str_end);
-      if (begin != state.first.second) {
-        return state.first.second;
-      }
-    }
-
-    return begin + 1;
-  } else {
-    for (auto &range:ranges_) {
-      if (*begin >= range.first && *begin <= range.second) {
-        return begin + 1;
-      }
-    }
-
-    for (auto special_pattern:special_patterns_) {
-      begin = special_pattern.NextMatch(state, str_end);
-      if (begin != state.first.second) {
-        return begin;
-      }
+  if (char_set_.Contains(*begin)) {
+    return except_ ? begin : begin + 1;
+  }
+  for (const auto &special_pattern:special_patterns_) {
+    auto next = special_pattern.NextMatch(begin, str_end, slots);
+    if (next != begin) {
+      return except_ ? begin : next;
     }
-
-    return begin;
   }
+  return except_ ? begin + 1 : begin;
 }
 }
 
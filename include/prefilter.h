@@ -0,0 +1,416 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#ifndef XYREGENGINE_PREFILTER_H
+#define XYREGENGINE_PREFILTER_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <bitset>
+#include <climits>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+
+#include <emmintrin.h>
+
+#endif
+
+// Teddy needs SSSE3, which is enabled per function and checked when the
+// program runs.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+#include <tmmintrin.h>
+
+#define XYREGENGINE_TEDDY
+
+#endif
+
+#include "aho_corasick.h"
+#include "char_class.h"
+#include "lex.h"
+
+namespace XyRegEngine {
+/**
+ * It finds locations where a match may begin with the help of literal
+ * strings which every match contains. The literals begin at most
+ * max_offset characters after the beginning of the match, so a match can
+ * only begin in a window before a literal. A search can skip everything
+ * outside the windows when no thread is alive.
+ *
+ * Literals are found by their first characters with char_traits<T>::find,
+ * which is memchr for char. For char, a SSE2 scanner is used when there are
+ * at most kMaxVectorCharacters first characters. A single literal is also
+ * checked against its last character in the same vector, so most false
+ * candidates are dropped before the literal is compared. More literals are
+ * found by Teddy, which looks up the first characters of all literals in
+ * 16 bytes at once with a shuffle. Beyond kMaxTeddyLiterals, candidates
+ * are verified by an Aho-Corasick automaton instead of one literal at a
+ * time.
+ */
+template<class T>
+class Prefilter {
+ public:
+  static constexpr int kMaxVectorCharacters = 3;
+  static constexpr int kMaxTeddyLiterals = 32;
+
+  Prefilter() = default;
+
+  /**
+   * @param literals They should not contain the empty string. Otherwise
+   * every location is a candidate.
+   * @param max_offset The largest distance from the beginning of a match to
+   * the literal it contains. INT_MAX means there is no bound. It is 0 for
+   * prefixes.
+   */
+  explicit Prefilter(const std::set<std::basic_string<T>> &literals,
+                     int max_offset = 0);
+
+  [[nodiscard]] bool Empty() const {
+    return literals_.empty();
+  }
+
+  /**
+   * @param begin
+   * @param end
+   * @return Locations [first, second) where a match may begin. No match
+   * begins in [begin, first). first is end if no match begins in
+   * [begin, end). A caller should ask again from the location after second.
+   */
+  [[nodiscard]] std::pair<StrConstIt<T>, StrConstIt<T>>
+  Find(StrConstIt<T> begin, StrConstIt<T> end) const;
+
+  /**
+   * @param begin
+   * @param end
+   * @return the first location in [begin, end) where a literal begins, or
+   * end if no such location exists
+   */
+  [[nodiscard]] StrConstIt<T> FindLiteral(StrConstIt<T> begin,
+                                          StrConstIt<T> end) const;
+
+ private:
+  static constexpr int kTeddyBuckets = 8;
+  static constexpr int kMaxFingerprint = 3;
+
+  /**
+   * @return the first location in [begin, end) which may begin a literal
+   */
+  [[nodiscard]] StrConstIt<T> NextCandidate(StrConstIt<T> begin,
+                                            StrConstIt<T> end) const;
+
+  [[nodiscard]] bool IsLiteral(const std::basic_string<T> &literal,
+                               StrConstIt<T> begin, StrConstIt<T> end) const {
+    return static_cast<std::size_t>(end - begin) >= literal.size() &&
+           std::equal(literal.cbegin(), literal.cend(), begin);
+  }
+
+#if defined(__SSE2__)
+
+  /**
+   * Compare 16 bytes a time with first_characters_ and, for a single
+   * literal, its last character at the same distance.
+   */
+  [[nodiscard]] StrConstIt<T> VectorCandidate(StrConstIt<T> begin,
+                                              StrConstIt<T> end) const;
+
+#endif
+
+#ifdef XYREGENGINE_TEDDY
+
+  /**
+   * Split literals_ into buckets and fill the nibble tables.
+   */
+  void TeddyInit();
+
+  /**
+   * Every byte of a block gets a bit for every bucket whose literals may
+   * begin there. The bit is looked up for the low and high nibbles of the
+   * first fingerprint_ characters, and a literal is verified only when all
+   * lookups keep the bit.
+   */
+  [[nodiscard]] __attribute__((target("ssse3")))
+  StrConstIt<T> TeddyFind(StrConstIt<T> begin, StrConstIt<T> end) const;
+
+  static bool HasSsse3() {
+    static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+    return has_ssse3;
+  }
+
+#endif
+
+  // A literal beginning with another literal is never needed, so none of
+  // them begins with another one.
+  std::vector<std::basic_string<T>> literals_;
+  int max_offset_{0};
+  // distinct first characters of literals_ in ascending order
+  std::basic_string<T> first_characters_;
+  // first characters of literals_ when they all fit in a byte
+  std::bitset<CharClassMap<T>::kTableSize> first_character_table_;
+  // It is only built when there are more than kMaxTeddyLiterals literals.
+  AhoCorasick<T> aho_corasick_;
+
+  // the number of characters looked up by Teddy, 0 if it isn't used
+  int fingerprint_{0};
+  // indexes of literals_ in every bucket
+  std::array<std::vector<int>, kTeddyBuckets> buckets_;
+  // masks_[i][0][nibble] -- buckets allowing nibble as the low nibble of
+  // the i-th character, masks_[i][1][nibble] for the high nibble
+  std::array<std::array<std::array<uint8_t, 16>, 2>, kMaxFingerprint> masks_{};
+};
+
+template<class T>
+Prefilter<T>::Prefilter(const std::set<std::basic_string<T>> &literals,
+                        int max_offset) : max_offset_(max_offset) {
+  using namespace std;
+
+  // Literals are sorted, so a literal follows those it begins with.
+  for (const auto &literal:literals) {
+    if (!literals_.empty() && literal.starts_with(literals_.back())) {
+      continue;
+    }
+    literals_.push_back(literal);
+    first_characters_.push_back(literal[0]);
+  }
+  sort(first_characters_.begin(), first_characters_.end());
+  first_characters_.erase(
+          unique(first_characters_.begin(), first_characters_.end()),
+          first_characters_.end());
+  for (auto c:first_characters_) {
+    if (CodePoint(c) < CharClassMap<T>::kTableSize) {
+      first_character_table_.set(CodePoint(c));
+    }
+  }
+
+  if (literals_.size() > kMaxTeddyLiterals) {
+    aho_corasick_ = AhoCorasick<T>(set<basic_string<T>>(literals_.cbegin(),
+                                                        literals_.cend()));
+  }
+
+#ifdef XYREGENGINE_TEDDY
+  if constexpr (sizeof(T) == 1) {
+    if (first_characters_.size() > kMaxVectorCharacters &&
+        literals_.size() <= kMaxTeddyLiterals) {
+      TeddyInit();
+    }
+  }
+#endif
+}
+
+template<class T>
+std::pair<StrConstIt<T>, StrConstIt<T>>
+Prefilter<T>::Find(StrConstIt<T> begin, StrConstIt<T> end) const {
+  auto literal = FindLiteral(begin, end);
+  if (literal == end) {
+    return {end, end};
+  }
+  if (literal - begin <= max_offset_) {
+    return {begin, literal + 1};
+  }
+  return {literal - max_offset_, literal + 1};
+}
+
+template<class T>
+StrConstIt<T> Prefilter<T>::FindLiteral(StrConstIt<T> begin,
+                                        StrConstIt<T> end) const {
+  if (!aho_corasick_.Empty()) {
+    std::pair<StrConstIt<T>, StrConstIt<T>> literal;
+    return aho_corasick_.Search(NextCandidate(begin, end), end, literal)
+           ? literal.first : end;
+  }
+
+#ifdef XYREGENGINE_TEDDY
+  if (fingerprint_ != 0 && HasSsse3()) {
+    return TeddyFind(begin, end);
+  }
+#endif
+
+  for (auto cur = begin; (cur = NextCandidate(cur, end)) != end; ++cur) {
+    for (const auto &literal:literals_) {
+      if (IsLiteral(literal, cur, end)) {
+        return cur;
+      }
+    }
+  }
+  return end;
+}
+
+template<class T>
+StrConstIt<T> Prefilter<T>::NextCandidate(StrConstIt<T> begin,
+                                          StrConstIt<T> end) const {
+  using namespace std;
+
+  if (begin == end) {
+    return end;
+  }
+
+#if defined(__SSE2__)
+  if constexpr (sizeof(T) == 1) {
+    if (first_characters_.size() <= kMaxVectorCharacters) {
+      return VectorCandidate(begin, end);
+    }
+  }
+#endif
+
+  if (first_characters_.size() == 1) {
+    auto it = char_traits<T>::find(&*begin, end - begin, first_characters_[0]);
+    return it == nullptr ? end : begin + (it - &*begin);
+  }
+
+  return find_if(begin, end, [this](T c) {
+    auto code_point = CodePoint(c);
+    if (code_point < CharClassMap<T>::kTableSize) {
+      return first_character_table_.test(code_point);
+    }
+    return binary_search(first_characters_.cbegin(),
+                         first_characters_.cend(), c);
+  });
+}
+
+#if defined(__SSE2__)
+
+template<class T>
+StrConstIt<T> Prefilter<T>::VectorCandidate(StrConstIt<T> begin,
+                                            StrConstIt<T> end) const {
+  using namespace std;
+
+  // Unused comparisons repeat the first character.
+  __m128i firsts[kMaxVectorCharacters];
+  for (int i = 0; i < kMaxVectorCharacters; ++i) {
+    firsts[i] = _mm_set1_epi8(static_cast<char>(
+            first_characters_[min<int>(i, first_characters_.size() - 1)]));
+  }
+  // A single literal also requires its last character at the same distance.
+  int last_distance = 0;
+  __m128i last = _mm_setzero_si128();
+  if (literals_.size() == 1) {
+    last_distance = literals_[0].size() - 1;
+    last = _mm_set1_epi8(static_cast<char>(literals_[0].back()));
+  }
+
+  auto cur = begin;
+  for (; end - cur >= 16 + last_distance; cur += 16) {
+    auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&*cur));
+    auto is_first = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, firsts[0]),
+                         _mm_cmpeq_epi8(block, firsts[1])),
+            _mm_cmpeq_epi8(block, firsts[2]));
+    if (last_distance != 0) {
+      auto last_block = _mm_loadu_si128(
+              reinterpret_cast<const __m128i *>(&*(cur + last_distance)));
+      is_first = _mm_and_si128(is_first, _mm_cmpeq_epi8(last_block, last));
+    }
+    auto mask = static_cast<unsigned int>(_mm_movemask_epi8(is_first));
+    if (mask != 0) {
+      return cur + countr_zero(mask);
+    }
+  }
+
+  // A literal cannot begin in the last last_distance characters.
+  for (; end - cur > last_distance; ++cur) {
+    if (first_character_table_.test(CodePoint(*cur))) {
+      return cur;
+    }
+  }
+  return end;
+}
+
+#endif
+
+#ifdef XYREGENGINE_TEDDY
+
+template<class T>
+void Prefilter<T>::TeddyInit() {
+  using namespace std;
+
+  fingerprint_ = kMaxFingerprint;
+  for (const auto &literal:literals_) {
+    fingerprint_ = min<int>(fingerprint_, literal.size());
+  }
+
+  // Sorted literals next to each other are likely to share the fingerprint,
+  // so they are put into the same bucket.
+  for (std::size_t i = 0; i < literals_.size(); ++i) {
+    int bucket = i * kTeddyBuckets / literals_.size();
+    buckets_[bucket].push_back(i);
+    for (int j = 0; j < fingerprint_; ++j) {
+      auto c = CodePoint(literals_[i][j]);
+      masks_[j][0][c & 0xf] |= 1 << bucket;
+      masks_[j][1][c >> 4] |= 1 << bucket;
+    }
+  }
+}
+
+template<class T>
+__attribute__((target("ssse3")))
+StrConstIt<T> Prefilter<T>::TeddyFind(StrConstIt<T> begin,
+                                      StrConstIt<T> end) const {
+  using namespace std;
+
+  __m128i low_masks[kMaxFingerprint], high_masks[kMaxFingerprint];
+  for (int i = 0; i < fingerprint_; ++i) {
+    low_masks[i] = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(masks_[i][0].data()));
+    high_masks[i] = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(masks_[i][1].data()));
+  }
+  auto low_nibble = _mm_set1_epi8(0xf);
+
+  auto verify = [this, end](StrConstIt<T> cur, unsigned int buckets) {
+    for (; buckets != 0; buckets &= buckets - 1) {
+      for (auto i:buckets_[countr_zero(buckets)]) {
+        if (IsLiteral(literals_[i], cur, end)) {
+          return true;
+        }
+      }
+    }
+    return false;
+  };
+
+  auto cur = begin;
+  for (; end - cur >= 16 + fingerprint_ - 1; cur += 16) {
+    auto candidates = _mm_set1_epi8(-1);
+    for (int i = 0; i < fingerprint_; ++i) {
+      auto block = _mm_loadu_si128(
+              reinterpret_cast<const __m128i *>(&*(cur + i)));
+      auto low = _mm_and_si128(block, low_nibble);
+      auto high = _mm_and_si128(_mm_srli_epi16(block, 4), low_nibble);
+      candidates = _mm_and_si128(
+              candidates,
+              _mm_and_si128(_mm_shuffle_epi8(low_masks[i], low),
+                            _mm_shuffle_epi8(high_masks[i], high)));
+    }
+    auto mask = ~static_cast<unsigned int>(_mm_movemask_epi8(
+            _mm_cmpeq_epi8(candidates, _mm_setzero_si128()))) & 0xffff;
+    if (mask == 0) {
+      continue;
+    }
+
+    alignas(16) array<uint8_t, 16> buckets;
+    _mm_store_si128(reinterpret_cast<__m128i *>(buckets.data()), candidates);
+    for (; mask != 0; mask &= mask - 1) {
+      int i = countr_zero(mask);
+      if (verify(cur + i, buckets[i])) {
+        return cur + i;
+      }
+    }
+  }
+
+  for (; cur != end; ++cur) {
+    if (verify(cur, (1 << kTeddyBuckets) - 1)) {
+      return cur;
+    }
+  }
+  return end;
+}
+
+#endif
+}
+
+#endif //XYREGENGINE_PREFILTER_H
@@ -0,0 +1,193 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#ifndef XYREGENGINE_REGEX_SET_H
+#define XYREGENGINE_REGEX_SET_H
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "dfa.h"
+#include "nfa.h"
+#include "xy_regex.h"
+
+namespace XyRegEngine {
+/**
+ * Many regexes that are matched together. They are joined into a single
+ * NFA by NfaFactory<T>::MakeSetNfa, whose accept states are tagged with
+ * the regexes. A lazy DFA on it, whose states are cached in a DfaCache
+ * like those of LazyDfa<T>, records the regexes accepted in every DFA
+ * state, so all matched regexes are found in one pass and a character
+ * costs one table lookup however many regexes there are.
+ *
+ * Regexes with assertions, back-references or large counted repetitions
+ * can't be handled by the DFA, so each of them is matched by its own
+ * Regex<T>.
+ */
+template<class T>
+class RegexSet {
+ public:
+  static constexpr int kDefaultMaxStates = 10000;
+
+  /**
+   * @param regexes
+   * @param max_states upper bound of cached states of every DFA
+   */
+  explicit RegexSet(const std::vector<std::basic_string<T>> &regexes,
+                    int max_states = kDefaultMaxStates);
+
+  [[nodiscard]] int Size() const {
+    return regex_num_;
+  }
+
+  /**
+   * @param s
+   * @return matched[i] tells whether regexes[i] matches the whole s
+   */
+  std::vector<bool> Match(const std::basic_string<T> &s);
+
+  /**
+   * @param s
+   * @return matched[i] tells whether regexes[i] matches a sub-string of s.
+   * It behaves the same as Regex<T>::Search, so a match never begins at the
+   * end of s.
+   */
+  std::vector<bool> Search(const std::basic_string<T> &s);
+
+ private:
+  /**
+   * Set regexes accepted in state as matched.
+   *
+   * @param cache
+   * @param state
+   * @param matched
+   * @param matched_num the number of regexes set in matched by the DFA
+   */
+  void Collect(DfaCache &cache, int state, std::vector<bool> &matched,
+               int &matched_num) const;
+
+  int regex_num_;
+  int max_states_;
+
+  // It is nullptr if no regex can be handled by a DFA.
+  std::unique_ptr<ClassNfa<T>> nfa_;
+  // the number of regexes handled by nfa_
+  int nfa_regex_num_{0};
+
+  // It is used by Match.
+  DfaCache anchored_dfa_;
+  // It is used by Search. Every state is marked with the last search
+  // reaching it, so regexes accepted in a state are only collected once in
+  // a search.
+  DfaCache unanchored_dfa_;
+  int search_num_{0};
+
+  // regexes matched by their own Regex<T> and their indexes
+  std::vector<std::pair<int, std::unique_ptr<Regex<T>>>> fallbacks_;
+};
+
+template<class T>
+RegexSet<T>::RegexSet(const std::vector<std::basic_string<T>> &regexes,
+                      int max_states)
+        : regex_num_(regexes.size()), max_states_(max_states) {
+  using namespace std;
+
+  vector<int> accept_states;
+  auto nfa = NfaFactory<T>::MakeSetNfa(regexes, accept_states);
+  for (int i = 0; i < regex_num_; ++i) {
+    if (accept_states[i] >= 0) {
+      ++nfa_regex_num_;
+    } else {
+      fallbacks_.emplace_back(i, make_unique<Regex<T>>(regexes[i]));
+    }
+  }
+  if (nfa.Empty()) {
+    return;
+  }
+
+  nfa_ = make_unique<ClassNfa<T>>(nfa, accept_states);
+  auto owner = DfaCache::NewOwner();
+  anchored_dfa_.Reset(*nfa_, owner, max_states_);
+  unanchored_dfa_.Reset(*nfa_, owner, max_states_, false);
+}
+
+template<class T>
+std::vector<bool> RegexSet<T>::Match(const std::basic_string<T> &s) {
+  using namespace std;
+
+  vector<bool> matched(regex_num_);
+  if (nfa_) {
+    auto &cache = anchored_dfa_;
+    int state = cache.GetStartState();
+    for (auto it = s.cbegin();
+         it != s.cend() && state != DfaCache::kDeadState; ++it) {
+      int char_class = nfa_->GetCharClass(*it);
+      int next_state = cache.GetNextState(state, char_class);
+      if (next_state == DfaCache::kUnknownState) {
+        next_state = cache.Transit(*nfa_, state, char_class);
+      }
+      state = next_state;
+    }
+    for (auto regex:cache.GetTags(state)) {
+      matched[regex] = true;
+    }
+  }
+
+  RegexResult<T> result;
+  for (auto &[regex, fallback]:fallbacks_) {
+    matched[regex] = fallback->Match(s, result);
+  }
+  return matched;
+}
+
+template<class T>
+std::vector<bool> RegexSet<T>::Search(const std::basic_string<T> &s) {
+  using namespace std;
+
+  vector<bool> matched(regex_num_);
+  // A match never begins at the end, so nothing matches an empty string.
+  if (nfa_ && !s.empty()) {
+    auto &cache = unanchored_dfa_;
+    ++search_num_;
+    int matched_num = 0;
+    int state = cache.GetStartState();
+    Collect(cache, state, matched, matched_num);
+    for (auto it = s.cbegin();
+         it != s.cend() && matched_num != nfa_regex_num_; ++it) {
+      int char_class = nfa_->GetCharClass(*it);
+      int next_state = cache.GetNextState(state, char_class);
+      if (next_state == DfaCache::kUnknownState) {
+        next_state = cache.Transit(*nfa_, state, char_class);
+      }
+      state = next_state;
+      Collect(cache, state, matched, matched_num);
+    }
+  }
+
+  RegexResult<T> result;
+  for (auto &[regex, fallback]:fallbacks_) {
+    matched[regex] = fallback->Search(s, result);
+  }
+  return matched;
+}
+
+template<class T>
+void RegexSet<T>::Collect(DfaCache &cache, int state,
+                          std::vector<bool> &matched, int &matched_num) const {
+  if (cache.GetMark(state) == search_num_) {
+    return;
+  }
+  cache.SetMark(state, search_num_);
+  for (auto regex:cache.GetTags(state)) {
+    if (!matched[regex]) {
+      matched[regex] = true;
+      ++matched_num;
+    }
+  }
+}
+}
+
+#endif //XYREGENGINE_REGEX_SET_H
@@ -0,0 +1,215 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#ifndef XYREGENGINE_SPARSE_SET_H
+#define XYREGENGINE_SPARSE_SET_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace XyRegEngine {
+/**
+ * A set of integers in [0, capacity). Elements are stored in insertion
+ * order in dense_, and sparse_[value] is the index of value in dense_, so
+ * inserting, testing membership and clearing all take constant time.
+ * Clearing only resets the size, so a set never allocates after it is
+ * resized.
+ */
+class SparseSet {
+ public:
+  SparseSet() = default;
+
+  explicit SparseSet(int capacity) : sparse_(capacity), dense_(capacity) {}
+
+  /**
+   * Change the capacity and clear the set.
+   *
+   * @param capacity
+   */
+  void Resize(int capacity) {
+    sparse_.assign(capacity, 0);
+    dense_.assign(capacity, 0);
+    size_ = 0;
+  }
+
+  [[nodiscard]] int Capacity() const {
+    return static_cast<int>(dense_.size());
+  }
+
+  [[nodiscard]] int Size() const {
+    return size_;
+  }
+
+  [[nodiscard]] bool Empty() const {
+    return size_ == 0;
+  }
+
+  /**
+   * @param value must be in [0, capacity)
+   * @return
+   */
+  [[nodiscard]] bool Contains(int value) const {
+    // sparse_[value] may be stale, so it is checked against dense_.
+    int index = sparse_[value];
+    return index < size_ && dense_[index] == value;
+  }
+
+  /**
+   * @param value must be in [0, capacity)
+   * @return whether value is newly inserted
+   */
+  bool Insert(int value) {
+    if (Contains(value)) {
+      return false;
+    }
+    sparse_[value] = size_;
+    dense_[size_++] = value;
+    return true;
+  }
+
+  void Clear() {
+    size_ = 0;
+  }
+
+  /**
+   * Elements are iterated in insertion order.
+   */
+  [[nodiscard]] std::vector<int>::const_iterator begin() const {
+    return dense_.cbegin();
+  }
+
+  [[nodiscard]] std::vector<int>::const_iterator end() const {
+    return dense_.cbegin() + size_;
+  }
+
+ private:
+  std::vector<int> sparse_;
+  std::vector<int> dense_;
+  int size_{0};
+};
+
+/**
+ * A set of integer tuples of the same width, e.g. NFA states followed by
+ * their counters. Tuples are stored in insertion order and found through
+ * an open addressing table. A bucket only counts when its stamp is the one
+ * of the set, so clearing just bumps the stamp, and like SparseSet, a set
+ * never allocates once it is large enough.
+ */
+class TupleSet {
+ public:
+  TupleSet() = default;
+
+  explicit TupleSet(int width) : width_(width) {}
+
+  /**
+   * Change the width and clear the set.
+   *
+   * @param width must be positive
+   */
+  void Reset(int width) {
+    width_ = width;
+    Clear();
+  }
+
+  [[nodiscard]] int Width() const {
+    return width_;
+  }
+
+  [[nodiscard]] int Size() const {
+    return static_cast<int>(tuples_.size()) / width_;
+  }
+
+  [[nodiscard]] bool Empty() const {
+    return tuples_.empty();
+  }
+
+  /**
+   * @param tuple Its size must be the width.
+   * @return
+   */
+  [[nodiscard]] bool Contains(std::span<const int> tuple) const {
+    return !buckets_.empty() && buckets_[Find(tuple)].first == stamp_;
+  }
+
+  /**
+   * @param tuple Its size must be the width.
+   * @return whether tuple is newly inserted
+   */
+  bool Insert(std::span<const int> tuple) {
+    // At most half of the buckets are used.
+    if (2 * (tuples_.size() / width_ + 1) > buckets_.size()) {
+      Rehash();
+    }
+    auto &bucket = buckets_[Find(tuple)];
+    if (bucket.first == stamp_) {
+      return false;
+    }
+    bucket = {stamp_, Size()};
+    tuples_.insert(tuples_.end(), tuple.begin(), tuple.end());
+    return true;
+  }
+
+  void Clear() {
+    tuples_.clear();
+    if (++stamp_ == 0) {  // Stale buckets would count again.
+      buckets_.assign(buckets_.size(), {0, 0});
+      stamp_ = 1;
+    }
+  }
+
+  /**
+   * @param index in insertion order
+   * @return
+   */
+  [[nodiscard]] std::span<const int> operator[](int index) const {
+    return {tuples_.data() + static_cast<std::size_t>(index) * width_,
+            static_cast<std::size_t>(width_)};
+  }
+
+ private:
+  /**
+   * @return the bucket of tuple, or the empty bucket where it would be
+   * inserted
+   */
+  [[nodiscard]] std::size_t Find(std::span<const int> tuple) const {
+    std::uint64_t hash = 0xcbf29ce484222325;
+    for (auto value:tuple) {
+      hash = (hash ^ static_cast<std::uint32_t>(value)) * 0x100000001b3;
+    }
+    std::size_t mask = buckets_.size() - 1;
+    for (std::size_t i = (hash ^ hash >> 32) & mask;; i = (i + 1) & mask) {
+      const auto &bucket = buckets_[i];
+      if (bucket.first != stamp_ ||
+          std::equal(tuple.begin(), tuple.end(),
+                     tuples_.cbegin() +
+                     static_cast<std::ptrdiff_t>(bucket.second) * width_)) {
+        return i;
+      }
+    }
+  }
+
+  /**
+   * Double the buckets and insert all tuples again.
+   */
+  void Rehash() {
+    buckets_.assign(buckets_.empty() ? 16 : 2 * buckets_.size(), {0, 0});
+    stamp_ = 1;
+    for (int i = 0; i < Size(); ++i) {
+      buckets_[Find((*this)[i])] = {stamp_, i};
+    }
+  }
+
+  std::vector<int> tuples_;
+  // (stamp, index of a tuple)
+  std::vector<std::pair<unsigned int, int>> buckets_;
+  unsigned int stamp_{1};
+  int width_{1};
+};
+}
+
+#endif //XYREGENGINE_SPARSE_SET_H
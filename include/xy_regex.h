@@ -5,16 +5,34 @@
 #ifndef XYREGENGINE_XY_REGEX_H
 #define XYREGENGINE_XY_REGEX_H
 
+#include <cstddef>
+#include <iterator>
+#include <memory>
+
+#include "aho_corasick.h"
+#include "dfa.h"
+#include "glushkov_nfa.h"
+#include "literal_searcher.h"
+#include "literal.h"
 #include "nfa.h"
+#include "prefilter.h"
 
 namespace XyRegEngine {
 template<class T>
 class Regex;
 
+template<class T>
+class RegexIterator;
+
+template<class T>
+class RegexRange;
+
 template<class T>
 class RegexResult {
   friend class Regex<T>;
 
+  friend class RegexIterator<T>;
+
  public:
   [[nodiscard]] SubMatch<T> GetResult() const {
     return result_;
@@ -33,65 +51,411 @@ class RegexResult {
 template<class T>
 class Regex {
  public:
-  explicit Regex(const std::basic_string<T> &regex) : nfa_(regex) {}
+  explicit Regex(const std::basic_string<T> &regex) {
+    std::basic_string<T> literal;
+    if (LiteralExtractor<T>::ExtractString(regex, literal)) {
+      // A plain string needs no automaton at all.
+      literal_searcher_ =
+              std::make_unique<LiteralSearcher<T>>(std::move(literal));
+      return;
+    }
+
+    nfa_ = Nfa<T>(regex);
+    auto glushkov_nfa = std::make_unique<GlushkovNfa<T>>(regex);
+    if (!glushkov_nfa->Empty()) {
+      glushkov_nfa_ = std::move(glushkov_nfa);
+    } else if (LazyDfa<T>::IsSupported(nfa_)) {
+      auto literals = LiteralExtractor<T>::ExtractExact(regex);
+      if (!literals.empty()) {
+        // It finds matches by itself, so no prefilter is needed.
+        aho_corasick_ = std::make_unique<AhoCorasick<T>>(literals);
+        return;
+      }
+      lazy_dfa_ = std::make_unique<LazyDfa<T>>(nfa_);
+    }
+
+    int max_offset;
+    auto literals = LiteralExtractor<T>::ExtractRequired(regex, max_offset);
+    if (!literals.empty()) {
+      prefilter_ = Prefilter<T>(literals, max_offset);
+    }
+  }
+
+  /**
+   * Compiled engines are deep-copied, so the copy and regex can be used in
+   * different threads. The copy gets a fresh scratch.
+   *
+   * @param regex
+   */
+  Regex(const Regex &regex)
+          : nfa_(regex.nfa_),
+            literal_searcher_(Clone(regex.literal_searcher_)),
+            glushkov_nfa_(Clone(regex.glushkov_nfa_)),
+            aho_corasick_(Clone(regex.aho_corasick_)),
+            lazy_dfa_(Clone(regex.lazy_dfa_)),
+            dfa_(Clone(regex.dfa_)),
+            prefilter_(regex.prefilter_) {}
+
+  Regex(Regex &&regex) noexcept = default;
+
+  Regex &operator=(const Regex &regex) {
+    if (this != &regex) {
+      *this = Regex(regex);
+    }
+    return *this;
+  }
+
+  Regex &operator=(Regex &&regex) noexcept = default;
+
+  /**
+   * Build a minimized DFA ahead of time and use it for all later matches.
+   * It is worth doing when the regex is used for a large number of times.
+   * If the regex is a plain string or contains groups or assertions, or the
+   * DFA needs more than 'max_states' states, it fails and the current engine
+   * is kept.
+   *
+   * @param max_states
+   * @return whether the DFA is built
+   */
+  bool CompileDfa(int max_states = Dfa<T>::kDefaultMaxStates);
 
   /**
    * Determine whether s matches the regex.
    *
    * @param s
-   * @param result store detailed result
+   * @param result store detailed result. Sub-matches of an earlier result
+   * are cleared.
    * @return
    */
-  bool Match(const std::basic_string<T> &s, RegexResult<T> &result);
+  bool Match(const std::basic_string<T> &s, RegexResult<T> &result) {
+    return Match(s, result, scratch_);
+  }
+
+  /**
+   * The same as Match(s, result), but all engines take their buffers and
+   * cached states from scratch. When result and scratch are reused, matching
+   * doesn't allocate once they are large enough, since sub-matches and
+   * counters of threads are kept in rows of scratch. The regex itself isn't
+   * written, so several threads can share it as long as each one passes its
+   * own scratch.
+   *
+   * @param s
+   * @param result
+   * @param scratch
+   * @return
+   */
+  bool Match(const std::basic_string<T> &s, RegexResult<T> &result,
+             MatchScratch<T> &scratch) const;
 
   /**
    * Determine whether a sub-string in s matches the regex.
    *
    * @param s
-   * @param result store detailed result
+   * @param result store detailed result. Sub-matches of an earlier result
+   * are cleared.
+   * @return
+   */
+  bool Search(const std::basic_string<T> &s, RegexResult<T> &result) {
+    return Search(s.cbegin(), s.cend(), result, scratch_);
+  }
+
+  /**
+   * The same as Search(s, result), but all engines take their buffers from
+   * scratch like Match(s, result, scratch).
+   *
+   * @param s
+   * @param result
+   * @param scratch
    * @return
    */
-  bool Search(const std::basic_string<T> &s, RegexResult<T> &result);
+  bool Search(const std::basic_string<T> &s, RegexResult<T> &result,
+              MatchScratch<T> &scratch) const {
+    return Search(s.cbegin(), s.cend(), result, scratch);
+  }
+
+  /**
+   * Find all non-overlapping matches in s lazily, e.g.
+   * for (const auto &result:regex.SearchAll(s)) {...}
+   *
+   * @param s It should outlive the returned range.
+   * @return a range of RegexIterator
+   */
+  RegexRange<T> SearchAll(const std::basic_string<T> &s);
+
+  RegexRange<T> SearchAll(const std::basic_string<T> &&s) = delete;
 
  private:
+  friend class RegexIterator<T>;
+
+  /**
+   * Search in the range of [begin, end). A match never begins at end.
+   */
+  bool Search(StrConstIt<T> begin, StrConstIt<T> end, RegexResult<T> &result,
+              MatchScratch<T> &scratch) const;
+
+  // It is empty if literal_searcher_ is built.
   Nfa<T> nfa_;
+
+  // It is only built for plain strings, and then no other engine is built.
+  std::unique_ptr<LiteralSearcher<T>> literal_searcher_;
+
+  // It is only built for small regexes without groups and assertions.
+  std::unique_ptr<GlushkovNfa<T>> glushkov_nfa_;
+
+  // It is only built for alternations of literals that are too large for
+  // glushkov_nfa_, e.g. a long list of keywords.
+  std::unique_ptr<AhoCorasick<T>> aho_corasick_;
+
+  // It is only built for other regexes without groups and assertions that
+  // are too large for glushkov_nfa_. If none of them is built, nfa_ is used
+  // for matching.
+  std::unique_ptr<LazyDfa<T>> lazy_dfa_;
+
+  // It is built by CompileDfa and has the highest priority.
+  std::unique_ptr<Dfa<T>> dfa_;
+
+  // It holds literals that every match contains and is empty if there are
+  // none. Search skips to its candidates whenever no thread is alive.
+  Prefilter<T> prefilter_;
+
+  // used by matches without a scratch from the caller
+  MatchScratch<T> scratch_;
+
+  template<class Engine>
+  static std::unique_ptr<Engine> Clone(const std::unique_ptr<Engine> &engine) {
+    return engine ? std::make_unique<Engine>(*engine) : nullptr;
+  }
+
+  [[nodiscard]] const Prefilter<T> *GetPrefilter() const {
+    return prefilter_.Empty() ? nullptr : &prefilter_;
+  }
+
+  /**
+   * @return whether an engine without sub-matches can be used
+   */
+  [[nodiscard]] bool HasAutomaton() const {
+    return literal_searcher_ || dfa_ || glushkov_nfa_ || aho_corasick_ ||
+           lazy_dfa_;
+  }
+
+  /**
+   * Find the longest match from begin with literal_searcher_, dfa_,
+   * glushkov_nfa_, aho_corasick_ or lazy_dfa_.
+   */
+  bool AutomatonNextMatch(StrConstIt<T> begin, StrConstIt<T> end,
+                          StrConstIt<T> &match_end,
+                          MatchScratch<T> &scratch) const {
+    if (literal_searcher_) {
+      return literal_searcher_->NextMatch(begin, end, match_end);
+    }
+    if (dfa_) {
+      return dfa_->NextMatch(begin, end, match_end);
+    }
+    if (glushkov_nfa_) {
+      return glushkov_nfa_->NextMatch(begin, end, match_end);
+    }
+    if (aho_corasick_) {
+      return aho_corasick_->NextMatch(begin, end, match_end);
+    }
+    return lazy_dfa_->NextMatch(begin, end, match_end, scratch);
+  }
+
+  /**
+   * Find the leftmost match with literal_searcher_, dfa_, glushkov_nfa_,
+   * aho_corasick_ or lazy_dfa_.
+   */
+  bool AutomatonSearch(StrConstIt<T> begin, StrConstIt<T> end,
+                       SubMatch<T> &match, MatchScratch<T> &scratch) const {
+    if (literal_searcher_) {
+      return literal_searcher_->Search(begin, end, match);
+    }
+    if (dfa_) {
+      return dfa_->Search(begin, end, match, scratch, GetPrefilter());
+    }
+    if (glushkov_nfa_) {
+      return glushkov_nfa_->Search(begin, end, match, GetPrefilter());
+    }
+    if (aho_corasick_) {
+      return aho_corasick_->Search(begin, end, match);
+    }
+    return lazy_dfa_->Search(begin, end, match, scratch, GetPrefilter());
+  }
 };
 
 template<class T>
-bool Regex<T>::Match(const std::basic_string<T> &s, RegexResult<T> &result) {
-  auto state_ptr = nfa_.NextMatch(s.cbegin(), s.cend());
+bool Regex<T>::CompileDfa(int max_states) {
+  if (literal_searcher_) {
+    return false;
+  }
+  auto dfa = std::make_unique<Dfa<T>>(nfa_, max_states);
+  if (dfa->Empty()) {
+    return false;
+  }
+  dfa_ = std::move(dfa);
+  return true;
+}
 
-  if (state_ptr == nullptr || state_ptr->first.second != s.cend()) {
+template<class T>
+bool Regex<T>::Match(const std::basic_string<T> &s, RegexResult<T> &result,
+                     MatchScratch<T> &scratch) const {
+  result.sub_matches_.clear();
+  if (HasAutomaton()) {
+    StrConstIt<T> match_end;
+    if (!AutomatonNextMatch(s.cbegin(), s.cend(), match_end, scratch) ||
+        match_end != s.cend()) {
+      return false;
+    }
+    result.result_ = {s.cbegin(), s.cend()};
+    return true;
+  }
+
+  auto state = nfa_.NextMatch(s.cbegin(), s.cend(), scratch);
+
+  if (state == nullptr || state->first.second != s.cend()) {
     return false;
   }
 
   // set result
   result.result_ = {s.cbegin(), s.cend()};
-  for (const auto &sub_match:state_ptr->second) {
-    result.sub_matches_.emplace_back(sub_match.first, sub_match.second);
+  result.sub_matches_.assign(state->second.cbegin(), state->second.cend());
+  return true;
+}
+
+template<class T>
+RegexRange<T> Regex<T>::SearchAll(const std::basic_string<T> &s) {
+  return RegexRange<T>(s.cbegin(), s.cend(), *this);
+}
+
+template<class T>
+bool Regex<T>::Search(StrConstIt<T> begin, StrConstIt<T> end,
+                      RegexResult<T> &result,
+                      MatchScratch<T> &scratch) const {
+  result.sub_matches_.clear();
+  if (HasAutomaton()) {
+    return AutomatonSearch(begin, end, result.result_, scratch);
+  }
+
+  StrConstIt<T> match_begin;
+  auto state = nfa_.Search(begin, end, match_begin, scratch, GetPrefilter());
+  if (state == nullptr) {
+    return false;
   }
+
+  result.result_ = {match_begin, state->first.second};
+  result.sub_matches_.assign(state->second.cbegin(), state->second.cend());
   return true;
 }
 
+/**
+ * An input iterator over non-overlapping matches of a regex in a string.
+ * Every search begins where the last match ends, so all matches are found
+ * in a single pass. After an empty match the search begins one character
+ * later, since the match is already the longest one at its location. The
+ * regex and the result are reused by all matches, so a match is only
+ * valid until the iterator moves.
+ *
+ * A default constructed iterator is the end iterator.
+ */
 template<class T>
-bool Regex<T>::Search(const std::basic_string<T> &s, RegexResult<T> &result) {
-  auto begin = s.cbegin(), end = s.cend();
-
-  while (begin != end) {
-    auto state_ptr = nfa_.NextMatch(begin, end);
-    if (state_ptr != nullptr) {
-      result.result_ = {begin, state_ptr->first.second};
-      for (const auto &sub_match:state_ptr->second) {
-        result.sub_matches_.emplace_back(sub_match.first, sub_match.second);
-      }
+class RegexIterator {
+ public:
+  using iterator_category = std::input_iterator_tag;
+  using value_type = RegexResult<T>;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const RegexResult<T> *;
+  using reference = const RegexResult<T> &;
 
-      return true;
+  RegexIterator() = default;
+
+  /**
+   * @param begin
+   * @param end
+   * @param regex It should outlive the iterator.
+   */
+  RegexIterator(StrConstIt<T> begin, StrConstIt<T> end, Regex<T> &regex)
+          : regex_(&regex), cur_(begin), end_(end) {
+    Next();
+  }
+
+  reference operator*() const {
+    return result_;
+  }
+
+  pointer operator->() const {
+    return &result_;
+  }
+
+  RegexIterator &operator++() {
+    Next();
+    return *this;
+  }
+
+  RegexIterator operator++(int) {
+    auto it = *this;
+    Next();
+    return it;
+  }
+
+  bool operator==(const RegexIterator &it) const {
+    if (!regex_ || !it.regex_) {
+      return regex_ == it.regex_;
     }
-    begin++;
+    return result_.result_ == it.result_.result_;
   }
 
-  return false;
+ private:
+  /**
+   * Find the next match and become the end iterator if there is none.
+   */
+  void Next();
+
+  // It is nullptr for the end iterator.
+  Regex<T> *regex_{nullptr};
+  // where the next search begins
+  StrConstIt<T> cur_;
+  StrConstIt<T> end_;
+  RegexResult<T> result_;
+};
+
+template<class T>
+void RegexIterator<T>::Next() {
+  if (!regex_) {
+    return;
+  }
+
+  if (!regex_->Search(cur_, end_, result_, regex_->scratch_)) {
+    regex_ = nullptr;
+    return;
+  }
+  cur_ = result_.result_.second;
+  if (result_.result_.first == result_.result_.second && cur_ != end_) {
+    ++cur_;
+  }
 }
+
+/**
+ * All matches of a regex in a string, so they can be visited in a
+ * range-based for loop. It is returned by Regex<T>::SearchAll.
+ */
+template<class T>
+class RegexRange {
+ public:
+  RegexRange(StrConstIt<T> begin, StrConstIt<T> end, Regex<T> &regex)
+          : begin_(begin), end_(end), regex_(regex) {}
+
+  [[nodiscard]] RegexIterator<T> begin() const {
+    return RegexIterator<T>(begin_, end_, regex_);
+  }
+
+  [[nodiscard]] RegexIterator<T> end() const {
+    return RegexIterator<T>();
+  }
+
+ private:
+  StrConstIt<T> begin_;
+  StrConstIt<T> end_;
+  Regex<T> &regex_;
+};
 }
 
 #endif //XYREGENGINE_XY_REGEX_H
\ No newline at end of file
@@ -0,0 +1,66 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#include "gtest/gtest.h"
+#include "aho_corasick.h"
+
+using namespace XyRegEngine;
+using namespace std;
+
+TEST(AhoCorasick, NextMatch) {
+  AhoCorasick<char> aho_corasick({"he", "her", "hers", "she"});
+  StrConstIt<char> match_end;
+
+  string s = "herself";
+  EXPECT_TRUE(aho_corasick.NextMatch(s.cbegin(), s.cend(), match_end));
+  EXPECT_EQ(string(s.cbegin(), match_end), "hers");
+
+  s = "hex";
+  EXPECT_TRUE(aho_corasick.NextMatch(s.cbegin(), s.cend(), match_end));
+  EXPECT_EQ(string(s.cbegin(), match_end), "he");
+
+  s = "sh";
+  EXPECT_FALSE(aho_corasick.NextMatch(s.cbegin(), s.cend(), match_end));
+}
+
+TEST(AhoCorasick, Search) {
+  AhoCorasick<char> aho_corasick({"abcd", "bc", "bcde", "cdef", "x"});
+  pair<StrConstIt<char>, StrConstIt<char>> match;
+
+  // "bc" is found first, but "abcd" begins earlier.
+  string s = "zabcdef";
+  EXPECT_TRUE(aho_corasick.Search(s.cbegin(), s.cend(), match));
+  EXPECT_EQ(match.first - s.cbegin(), 1);
+  EXPECT_EQ(string(match.first, match.second), "abcd");
+
+  // the longest literal beginning at the leftmost location
+  EXPECT_TRUE(aho_corasick.Search(s.cbegin() + 2, s.cend(), match));
+  EXPECT_EQ(string(match.first, match.second), "bcde");
+
+  s = "abcx";
+  EXPECT_TRUE(aho_corasick.Search(s.cbegin(), s.cend(), match));
+  EXPECT_EQ(string(match.first, match.second), "bc");
+
+  EXPECT_FALSE(aho_corasick.Search(s.cbegin() + 3, s.cend() - 1, match));
+}
+
+TEST(AhoCorasick, FailureLinks) {
+  // Deep states are sparse and follow failure links several times.
+  AhoCorasick<char> aho_corasick({"aaaab", "aab", "ac"});
+  pair<StrConstIt<char>, StrConstIt<char>> match;
+  string s = "aaaaac";
+
+  EXPECT_EQ(aho_corasick.GetStateNum(), 8);
+  EXPECT_TRUE(aho_corasick.Search(s.cbegin(), s.cend(), match));
+  EXPECT_EQ(match.first - s.cbegin(), 4);
+}
+
+TEST(AhoCorasick, UTF8) {
+  AhoCorasick<wchar_t> aho_corasick({L"的", L"目的", L"目标"});
+  pair<StrConstIt<wchar_t>, StrConstIt<wchar_t>> match;
+  wstring s = L"目目的";
+
+  EXPECT_TRUE(aho_corasick.Search(s.cbegin(), s.cend(), match));
+  EXPECT_EQ(wstring(match.first, match.second), L"目的");
+}
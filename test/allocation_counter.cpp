@@ -0,0 +1,33 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#include "allocation_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// The replacements are kept out of the translation units that allocate, so
+// the compiler never pairs an inlined operator new with free.
+static std::atomic<long> allocation_count{0};
+
+long GetAllocationCount() {
+  return allocation_count;
+}
+
+void *operator new(std::size_t size) {
+  ++allocation_count;
+  if (void *p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+  std::free(p);
+}
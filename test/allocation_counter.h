@@ -0,0 +1,14 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#ifndef XYREGENGINE_ALLOCATION_COUNTER_H
+#define XYREGENGINE_ALLOCATION_COUNTER_H
+
+/**
+ * @return number of calls to operator new so far. The global operators are
+ * only replaced in the executable of allocation_test.cpp.
+ */
+long GetAllocationCount();
+
+#endif //XYREGENGINE_ALLOCATION_COUNTER_H
@@ -0,0 +1,55 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#include "allocation_counter.h"
+#include "gtest/gtest.h"
+#include "xy_regex.h"
+
+#include <tuple>
+
+using namespace XyRegEngine;
+using namespace std;
+
+TEST(Regex, ScratchAllocation) {
+  // Once the scratch and the result are large enough, a later match
+  // allocates nothing, even with groups, counted repetitions,
+  // back-references and DFAs.
+  string repeats = "a";
+  for (int i = 0; i < 400; ++i) {
+    repeats += "bc";
+  }
+  repeats += "x";
+  string letters;
+  for (int i = 0; i < 300; ++i) {
+    letters += i * i % 7 < 3 ? 'a' : 'b';
+  }
+  // pattern, string, whether the DFA is compiled
+  vector<tuple<string, string, bool>> cases{
+          {"^(\\w)(\\w*)$", "word12345", false},
+          {"(\\d+)-(\\d+)", "on 2026-10 at 9-1", false},
+          {"((a)|b)+(?=c)", "abbac", false},
+          {"(a)(?:b|c){600,}x", repeats, false},
+          {"(a+)b\\1", "xaaba", false},
+          {"(?:a|b)*a(?:a|b){80}", letters, false},
+          {"[a-c]+\\d", "ddab1", true}};
+  for (const auto &[pattern, s, is_compiled]:cases) {
+    Regex<char> regex(pattern);
+    if (is_compiled) {
+      ASSERT_TRUE(regex.CompileDfa());
+    }
+    MatchScratch<char> scratch;
+    RegexResult<char> result;
+    // Lists of a run keyed by beginnings may be reused in another order,
+    // so the scratch is warmed up by a few matches.
+    for (int i = 0; i < 3; ++i) {
+      regex.Match(s, result, scratch);
+      EXPECT_TRUE(regex.Search(s, result, scratch)) << pattern;
+    }
+
+    long before = GetAllocationCount();
+    regex.Match(s, result, scratch);
+    regex.Search(s, result, scratch);
+    EXPECT_EQ(GetAllocationCount() - before, 0) << pattern;
+  }
+}
@@ -0,0 +1,55 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#include "gtest/gtest.h"
+#include "char_class.h"
+
+using namespace XyRegEngine;
+using namespace std;
+
+TEST(CharSet, Add) {
+  CharSet<char> char_set;
+  char_set.Add('a', 'c');
+  char_set.Add('b', 'e');
+  char_set.Add('f', 'f');
+  char_set.Add('z', 'x');  // empty
+
+  EXPECT_TRUE(char_set.Contains('a'));
+  EXPECT_TRUE(char_set.Contains('f'));
+  EXPECT_FALSE(char_set.Contains('g'));
+  EXPECT_FALSE(char_set.Contains('y'));
+  EXPECT_EQ(char_set.GetIntervals(),
+            (vector<CharSet<char>::Interval>{{'a', 'f'}}));
+}
+
+TEST(CharSet, Invert) {
+  CharSet<char> char_set;
+  char_set.Add('\n', '\n');
+  char_set.Invert();
+
+  EXPECT_FALSE(char_set.Contains('\n'));
+  EXPECT_TRUE(char_set.Contains('\0'));
+  EXPECT_TRUE(char_set.Contains('a'));
+  EXPECT_TRUE(char_set.Contains(static_cast<char>(0xff)));
+  EXPECT_EQ(char_set.GetIntervals(),
+            (vector<CharSet<char>::Interval>{{0, '\n' - 1},
+                                             {'\n' + 1, 0xff}}));
+
+  char_set.Invert();
+  EXPECT_EQ(char_set.GetIntervals(),
+            (vector<CharSet<char>::Interval>{{'\n', '\n'}}));
+}
+
+TEST(CharSet, WideCharacter) {
+  CharSet<wchar_t> char_set;
+  char_set.Add(L'a', L'a');
+  char_set.Add(0x4e00, 0x9fa5);
+  char_set.Invert();
+
+  EXPECT_FALSE(char_set.Contains(L'a'));
+  EXPECT_FALSE(char_set.Contains(L'中'));
+  EXPECT_TRUE(char_set.Contains(L'b'));
+  EXPECT_TRUE(char_set.Contains(0x9fa6));
+  EXPECT_TRUE(char_set.Contains(0x10000));
+}
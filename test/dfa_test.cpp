@@ -0,0 +1,187 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#include "gtest/gtest.h"
+#include "dfa.h"
+
+using namespace XyRegEngine;
+using namespace std;
+
+TEST(LazyDfa, Unsupported) {
+  EXPECT_FALSE(LazyDfa<char>::IsSupported(Nfa<char>("a|")));
+  EXPECT_FALSE(LazyDfa<char>::IsSupported(Nfa<char>("(a)b")));
+  EXPECT_FALSE(LazyDfa<char>::IsSupported(Nfa<char>("^ab")));
+  EXPECT_FALSE(LazyDfa<char>::IsSupported(Nfa<char>("(?=a)ab")));
+  EXPECT_TRUE(LazyDfa<char>::IsSupported(Nfa<char>("(?:ab)+")));
+}
+
+TEST(LazyDfa, Alternative) {
+  LazyDfa<char> dfa(Nfa<char>("a|b"));
+  string s = "abc";
+  auto begin = s.cbegin(), end = s.cend();
+  StrConstIt<char> match_end;
+
+  EXPECT_TRUE(dfa.NextMatch(begin, end, match_end));
+  EXPECT_EQ(string(begin, match_end), "a");
+
+  begin = match_end;
+  EXPECT_TRUE(dfa.NextMatch(begin, end, match_end));
+  EXPECT_EQ(string(begin, match_end), "b");
+
+  begin = match_end;
+  EXPECT_FALSE(dfa.NextMatch(begin, end, match_end));
+}
+
+TEST(LazyDfa, LongestMatch) {
+  LazyDfa<char> dfa(Nfa<char>("[a-c]{2,4}|ab"));
+  string s = "abcabd";
+  auto begin = s.cbegin(), end = s.cend();
+  StrConstIt<char> match_end;
+
+  EXPECT_TRUE(dfa.NextMatch(begin, end, match_end));
+  EXPECT_EQ(string(begin, match_end), "abca");
+}
+
+TEST(LazyDfa, EmptyMatch) {
+  LazyDfa<char> dfa(Nfa<char>("a*"));
+  string s = "b";
+  StrConstIt<char> match_end;
+
+  EXPECT_TRUE(dfa.NextMatch(s.cbegin(), s.cend(), match_end));
+  EXPECT_EQ(match_end, s.cbegin());
+}
+
+TEST(LazyDfa, SpecialPattern) {
+  LazyDfa<char> dfa(Nfa<char>("\\w+\\.\\d[^\\s]."));
+  string s = "cpp.1ab c";
+  StrConstIt<char> match_end;
+
+  EXPECT_TRUE(dfa.NextMatch(s.cbegin(), s.cend(), match_end));
+  EXPECT_EQ(string(s.cbegin(), match_end), "cpp.1ab");
+}
+
+TEST(LazyDfa, NotAsciiCharacter) {
+  LazyDfa<char> dfa(Nfa<char>(".+"));
+  string s = "a\xe7\x9a\x84\n";
+  StrConstIt<char> match_end;
+
+  EXPECT_TRUE(dfa.NextMatch(s.cbegin(), s.cend(), match_end));
+  EXPECT_EQ(string(s.cbegin(), match_end), "a\xe7\x9a\x84");
+}
+
+TEST(LazyDfa, ClearCache) {
+  // The cache can only hold the dead state, the start state and one more
+  // state, so it is cleared several times.
+  LazyDfa<char> dfa(Nfa<char>("abcd"), 3);
+  string s = "abcdabcd";
+  StrConstIt<char> match_end;
+
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_TRUE(dfa.NextMatch(s.cbegin(), s.cend(), match_end));
+    EXPECT_EQ(string(s.cbegin(), match_end), "abcd");
+  }
+}
+
+TEST(LazyDfa, UTF8) {
+  LazyDfa<wchar_t> dfa(Nfa<wchar_t>(L"[的-目]\\w"));
+  wstring s = L"的0";
+  StrConstIt<wchar_t> match_end;
+
+  EXPECT_TRUE(dfa.NextMatch(s.cbegin(), s.cend(), match_end));
+  EXPECT_EQ(wstring(s.cbegin(), match_end), L"的0");
+
+  s = L"的的";
+  EXPECT_FALSE(dfa.NextMatch(s.cbegin(), s.cend(), match_end));
+}
+
+TEST(LazyDfa, Search) {
+  // The cache is cleared several times during the search.
+  LazyDfa<char> dfa(Nfa<char>("a[a-c]*d|bc"), 3);
+  string s = "bbcabcd";
+  SubMatch<char> match;
+
+  EXPECT_TRUE(dfa.Search(s.cbegin(), s.cend(), match));
+  EXPECT_EQ(string(match.first, match.second), "bc");
+
+  EXPECT_TRUE(dfa.Search(s.cbegin() + 2, s.cend(), match));
+  EXPECT_EQ(string(match.first, match.second), "abcd");
+
+  s = "aaaaaa";
+  EXPECT_FALSE(dfa.Search(s.cbegin(), s.cend(), match));
+}
+
+TEST(Dfa, Unsupported) {
+  Dfa<char> dfa(Nfa<char>("(a)b"));
+
+  EXPECT_TRUE(dfa.Empty());
+}
+
+TEST(Dfa, Minimize) {
+  // The minimal DFA has 4 states for (a|b)*abb and a dead state for other
+  // characters.
+  Dfa<char> dfa(Nfa<char>("(?:a|b)*abb"));
+  string s = "babbab";
+  StrConstIt<char> match_end;
+
+  EXPECT_EQ(dfa.GetStateNum(), 5);
+  EXPECT_TRUE(dfa.NextMatch(s.cbegin(), s.cend(), match_end));
+  EXPECT_EQ(string(s.cbegin(), match_end), "babb");
+}
+
+TEST(Dfa, LongestMatch) {
+  Dfa<char> dfa(Nfa<char>("\\d+\\.?\\d*|\\w+"));
+  string s = "12.5a";
+  StrConstIt<char> match_end;
+
+  EXPECT_TRUE(dfa.NextMatch(s.cbegin(), s.cend(), match_end));
+  EXPECT_EQ(string(s.cbegin(), match_end), "12.5");
+
+  s = "12a.5";
+  EXPECT_TRUE(dfa.NextMatch(s.cbegin(), s.cend(), match_end));
+  EXPECT_EQ(string(s.cbegin(), match_end), "12a");
+}
+
+TEST(Dfa, Tags) {
+  vector<int> accept_states;
+  auto nfa = NfaFactory<char>::MakeSetNfa({"if", "[a-z]+", "\\d+"},
+                                          accept_states);
+  Dfa<char> dfa(nfa, accept_states);
+  string s = "if";
+  StrConstIt<char> match_end;
+  int tag;
+
+  // Both "if" and [a-z]+ match, and the earlier one wins.
+  EXPECT_TRUE(dfa.NextMatch(s.cbegin(), s.cend(), match_end, tag));
+  EXPECT_EQ(tag, 0);
+
+  s = "iff1";
+  EXPECT_TRUE(dfa.NextMatch(s.cbegin(), s.cend(), match_end, tag));
+  EXPECT_EQ(string(s.cbegin(), match_end), "iff");
+  EXPECT_EQ(tag, 1);
+
+  s = "12";
+  EXPECT_TRUE(dfa.NextMatch(s.cbegin(), s.cend(), match_end, tag));
+  EXPECT_EQ(tag, 2);
+}
+
+TEST(Dfa, TooManyStates) {
+  // The n-th character from the end is 'a', so the DFA needs 2^n states.
+  Nfa<char> nfa("(?:a|b)*a(?:a|b){10}");
+
+  EXPECT_TRUE(Dfa<char>(nfa, 100).Empty());
+  EXPECT_FALSE(Dfa<char>(nfa, 5000).Empty());
+}
+
+TEST(Dfa, Search) {
+  Dfa<char> dfa(Nfa<char>("b*|a+"));
+  string s = "aab";
+  SubMatch<char> match;
+
+  // an empty match at the first location is the leftmost
+  EXPECT_TRUE(dfa.Search(s.cbegin(), s.cend(), match));
+  EXPECT_EQ(match.first, s.cbegin());
+  EXPECT_EQ(string(match.first, match.second), "aa");
+
+  EXPECT_FALSE(dfa.Search(s.cend(), s.cend(), match));
+}
@@ -0,0 +1,115 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#include "gtest/gtest.h"
+#include "glushkov_nfa.h"
+
+using namespace XyRegEngine;
+using namespace std;
+
+TEST(GlushkovNfa, Unsupported) {
+  EXPECT_TRUE(GlushkovNfa<char>("a|").Empty());
+  EXPECT_TRUE(GlushkovNfa<char>("(a)b").Empty());
+  EXPECT_TRUE(GlushkovNfa<char>("^ab").Empty());
+  EXPECT_TRUE(GlushkovNfa<char>("(?:a)\\1").Empty());
+  EXPECT_TRUE(GlushkovNfa<char>("a{65}").Empty());
+  EXPECT_FALSE(GlushkovNfa<char>("a{64}").Empty());
+  EXPECT_EQ(GlushkovNfa<char>("(?:ab)+c{2,3}").GetPositionNum(), 5);
+}
+
+TEST(GlushkovNfa, Alternative) {
+  GlushkovNfa<char> nfa("a|b");
+  string s = "abc";
+  auto begin = s.cbegin(), end = s.cend();
+  StrConstIt<char> match_end;
+
+  EXPECT_TRUE(nfa.NextMatch(begin, end, match_end));
+  EXPECT_EQ(string(begin, match_end), "a");
+
+  begin = match_end;
+  EXPECT_TRUE(nfa.NextMatch(begin, end, match_end));
+  EXPECT_EQ(string(begin, match_end), "b");
+
+  begin = match_end;
+  EXPECT_FALSE(nfa.NextMatch(begin, end, match_end));
+}
+
+TEST(GlushkovNfa, Quantifier) {
+  GlushkovNfa<char> nfa("[a-c]{2,4}d*e?|a+b{2,}");
+  StrConstIt<char> match_end;
+
+  string s = "abcabd";
+  EXPECT_TRUE(nfa.NextMatch(s.cbegin(), s.cend(), match_end));
+  EXPECT_EQ(string(s.cbegin(), match_end), "abca");
+
+  s = "abcdde";
+  EXPECT_TRUE(nfa.NextMatch(s.cbegin(), s.cend(), match_end));
+  EXPECT_EQ(string(s.cbegin(), match_end), "abcdde");
+
+  s = "aabbbc";
+  EXPECT_TRUE(nfa.NextMatch(s.cbegin(), s.cend(), match_end));
+  EXPECT_EQ(string(s.cbegin(), match_end), "aabbb");
+
+  s = "a";
+  EXPECT_FALSE(nfa.NextMatch(s.cbegin(), s.cend(), match_end));
+}
+
+TEST(GlushkovNfa, EmptyMatch) {
+  GlushkovNfa<char> nfa("a*");
+  string s = "b";
+  StrConstIt<char> match_end;
+
+  EXPECT_TRUE(nfa.NextMatch(s.cbegin(), s.cend(), match_end));
+  EXPECT_EQ(match_end, s.cbegin());
+
+  s = "";
+  EXPECT_TRUE(nfa.NextMatch(s.cbegin(), s.cend(), match_end));
+  EXPECT_EQ(match_end, s.cbegin());
+}
+
+TEST(GlushkovNfa, SpecialPattern) {
+  GlushkovNfa<char> nfa("[a-z]+@\\d+\\.[^\\s].");
+  string s = "dxy@126.com ";
+  StrConstIt<char> match_end;
+
+  EXPECT_TRUE(nfa.NextMatch(s.cbegin(), s.cend(), match_end));
+  EXPECT_EQ(string(s.cbegin(), match_end), "dxy@126.co");
+}
+
+TEST(GlushkovNfa, Search) {
+  GlushkovNfa<char> nfa("a\\w*c|\\d+");
+  string s = "x12abcbc";
+  SubMatch<char> match;
+
+  EXPECT_TRUE(nfa.Search(s.cbegin(), s.cend(), match));
+  EXPECT_EQ(string(match.first, match.second), "12");
+
+  EXPECT_TRUE(nfa.Search(s.cbegin() + 3, s.cend(), match));
+  EXPECT_EQ(string(match.first, match.second), "abcbc");
+
+  EXPECT_FALSE(nfa.Search(s.cbegin() + 4, s.cend(), match));
+}
+
+TEST(GlushkovNfa, ManyPositions) {
+  // positions are spread over all chunks of the follow tables
+  GlushkovNfa<char> nfa("(?:a|b){15}c{2,34}");
+  string s = string(15, 'a') + string(40, 'c');
+  StrConstIt<char> match_end;
+
+  EXPECT_EQ(nfa.GetPositionNum(), 64);
+  EXPECT_TRUE(nfa.NextMatch(s.cbegin(), s.cend(), match_end));
+  EXPECT_EQ(match_end - s.cbegin(), 49);
+}
+
+TEST(GlushkovNfa, UTF8) {
+  GlushkovNfa<wchar_t> nfa(L"[的-目]\\w");
+  wstring s = L"的0";
+  StrConstIt<wchar_t> match_end;
+
+  EXPECT_TRUE(nfa.NextMatch(s.cbegin(), s.cend(), match_end));
+  EXPECT_EQ(wstring(s.cbegin(), match_end), L"的0");
+
+  s = L"的的";
+  EXPECT_FALSE(nfa.NextMatch(s.cbegin(), s.cend(), match_end));
+}
@@ -14,12 +14,16 @@ using namespace XyRegEngine;
 using namespace std;
 
 void LexTest(const string &regex, queue<string> q) {
-  string lex;
-  decltype(lex.cbegin()) begin = regex.cbegin(), end = regex.cend();
+  string_view lex;
+  auto begin = regex.cbegin(), end = regex.cend();
   while (!(lex = NextToken<char>(begin, end)).empty()) {
     EXPECT_EQ(lex, q.front());
+    // a token is a view of the regex
+    EXPECT_EQ(lex.data() + lex.size(),
+              regex.data() + (begin - regex.cbegin()));
     q.pop();
   }
+  EXPECT_TRUE(q.empty());
 }
 
 TEST(Lexer, Range) {
@@ -115,4 +119,13 @@ TEST(Lexer, NonGreedy) {
   q.push("b");
 
   LexTest(regex, q);
-}
\ No newline at end of file
+}
+
+TEST(Lexer, TruncatedEscapeCharacter) {
+  string regex = "a\\u1";
+  queue<string> q;
+  q.push("a");
+  q.push("\\u1");
+
+  LexTest(regex, q);
+}
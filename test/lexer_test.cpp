@@ -0,0 +1,129 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#include "gtest/gtest.h"
+#include "lexer.h"
+
+using namespace XyRegEngine;
+using namespace std;
+
+enum TokenId {
+  kIf, kIdentifier, kNumber, kOperator, kSpace
+};
+
+Lexer<char> MakeLexer() {
+  return Lexer<char>({{"if", kIf},
+                      {"[a-zA-Z_]\\w*", kIdentifier},
+                      {"\\d+(?:\\.\\d+)?", kNumber},
+                      {"==|=|\\+", kOperator},
+                      {"\\s+", kSpace}});
+}
+
+TEST(RuleLexer, NextToken) {
+  auto lexer = MakeLexer();
+  string s = "iffy == 1";
+  Token<char> token;
+
+  // maximal munch
+  EXPECT_TRUE(lexer.NextToken(s.cbegin(), s.cend(), token));
+  EXPECT_EQ(token.id, kIdentifier);
+  EXPECT_EQ(string(token.lexeme.first, token.lexeme.second), "iffy");
+
+  s = "if(";
+  EXPECT_TRUE(lexer.NextToken(s.cbegin(), s.cend(), token));
+  EXPECT_EQ(token.id, kIf);
+
+  // A token must begin at the current location.
+  s = "(if";
+  EXPECT_FALSE(lexer.NextToken(s.cbegin(), s.cend(), token));
+  EXPECT_TRUE(lexer.SearchToken(s.cbegin(), s.cend(), token));
+  EXPECT_EQ(token.id, kIf);
+  EXPECT_EQ(token.lexeme.first - s.cbegin(), 1);
+}
+
+TEST(RuleLexer, Tokenize) {
+  auto lexer = MakeLexer();
+  string s = "if x1==2.5 + y";
+  vector<Token<char>> tokens;
+  vector<int> ids;
+
+  EXPECT_TRUE(lexer.Tokenize(s, tokens));
+  for (const auto &token:tokens) {
+    ids.push_back(token.id);
+  }
+  EXPECT_EQ(ids, (vector<int>{kIf, kSpace, kIdentifier, kOperator, kNumber,
+                              kSpace, kOperator, kSpace, kIdentifier}));
+  EXPECT_EQ(string(tokens[4].lexeme.first, tokens[4].lexeme.second), "2.5");
+
+  s = "a # b";
+  tokens.clear();
+  EXPECT_FALSE(lexer.Tokenize(s, tokens));
+  EXPECT_EQ(tokens.size(), 2);
+
+  tokens.clear();
+  EXPECT_TRUE(lexer.Tokenize(s, tokens, false));
+  EXPECT_EQ(tokens.size(), 4);
+}
+
+TEST(RuleLexer, EmptyMatch) {
+  // Empty matches are never tokens.
+  Lexer<char> lexer({{"a*", 0}, {"b", 1}});
+  string s = "aab";
+  vector<Token<char>> tokens;
+
+  EXPECT_TRUE(lexer.Tokenize(s, tokens));
+  EXPECT_EQ(tokens.size(), 2);
+  EXPECT_EQ(tokens[1].id, 1);
+
+  s = "xxb";
+  Token<char> token;
+  EXPECT_TRUE(lexer.SearchToken(s.cbegin(), s.cend(), token));
+  EXPECT_EQ(token.id, 1);
+  EXPECT_EQ(token.lexeme.first - s.cbegin(), 2);
+}
+
+TEST(RuleLexer, RejectedRules) {
+  // Rules a DFA can't handle are reported, and no token is found without
+  // them.
+  Lexer<char> lexer({{"a*", 0}, {"\\bb", 1}, {"(a)\\1", 2}, {"(", 3},
+                     {"a{2000}", 4}, {"b", 5}});
+  string s = "aab";
+  vector<Token<char>> tokens;
+
+  EXPECT_TRUE(lexer.Empty());
+  EXPECT_EQ(lexer.GetRejectedRules(), (vector<int>{1, 2, 3, 4}));
+  EXPECT_FALSE(lexer.Tokenize(s, tokens));
+
+  EXPECT_TRUE(Lexer<char>({{"a", 0}}).GetRejectedRules().empty());
+}
+
+TEST(RuleLexer, SearchToken) {
+  // The earliest token wins, and the longest one at that location.
+  auto lexer = MakeLexer();
+  string s = "(((== 12.5";
+  Token<char> token;
+
+  EXPECT_TRUE(lexer.SearchToken(s.cbegin(), s.cend(), token));
+  EXPECT_EQ(token.id, kOperator);
+  EXPECT_EQ(string(token.lexeme.first, token.lexeme.second), "==");
+
+  s = string(1000, '(') + "iffy";
+  EXPECT_TRUE(lexer.SearchToken(s.cbegin(), s.cend(), token));
+  EXPECT_EQ(token.id, kIdentifier);
+  EXPECT_EQ(token.lexeme.first - s.cbegin(), 1000);
+
+  s = "((";
+  EXPECT_FALSE(lexer.SearchToken(s.cbegin(), s.cend(), token));
+}
+
+TEST(RuleLexer, UTF8) {
+  Lexer<wchar_t> lexer({{L"[的-目]+", 0}, {L"\\w+", 1}});
+  wstring s = L"的目ab";
+  vector<Token<wchar_t>> tokens;
+
+  EXPECT_TRUE(lexer.Tokenize(s, tokens));
+  EXPECT_EQ(tokens.size(), 2);
+  EXPECT_EQ(tokens[0].id, 0);
+  EXPECT_EQ(tokens[1].id, 1);
+}
@@ -0,0 +1,68 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#include "gtest/gtest.h"
+#include "literal_searcher.h"
+
+using namespace XyRegEngine;
+using namespace std;
+
+TEST(LiteralSearcher, NextMatch) {
+  LiteralSearcher<char> searcher("user[id]");
+  StrConstIt<char> match_end;
+
+  string s = "user[id]=1";
+  EXPECT_TRUE(searcher.NextMatch(s.cbegin(), s.cend(), match_end));
+  EXPECT_EQ(string(s.cbegin(), match_end), "user[id]");
+
+  EXPECT_FALSE(searcher.NextMatch(s.cbegin() + 1, s.cend(), match_end));
+  EXPECT_FALSE(searcher.NextMatch(s.cbegin(), s.cbegin() + 7, match_end));
+}
+
+TEST(LiteralSearcher, Search) {
+  LiteralSearcher<char> searcher("abcab");
+  pair<StrConstIt<char>, StrConstIt<char>> match;
+
+  string s = "xabcaxabcbabcabcab";
+  EXPECT_TRUE(searcher.Search(s.cbegin(), s.cend(), match));
+  EXPECT_EQ(match.first - s.cbegin(), 10);
+  EXPECT_EQ(match.second - s.cbegin(), 15);
+
+  EXPECT_TRUE(searcher.Search(s.cbegin() + 11, s.cend(), match));
+  EXPECT_EQ(match.first - s.cbegin(), 13);
+
+  EXPECT_FALSE(searcher.Search(s.cbegin() + 14, s.cend(), match));
+}
+
+TEST(LiteralSearcher, SingleCharacter) {
+  LiteralSearcher<char> searcher(".");
+  pair<StrConstIt<char>, StrConstIt<char>> match;
+  string s = "conf.d";
+
+  EXPECT_TRUE(searcher.Search(s.cbegin(), s.cend(), match));
+  EXPECT_EQ(match.first - s.cbegin(), 4);
+  EXPECT_FALSE(searcher.Search(s.cbegin() + 5, s.cend(), match));
+}
+
+TEST(LiteralSearcher, Horspool) {
+  // Wide characters are always found by skipping windows. Windows ending
+  // with 'a', 'b' and 'c' move by different distances.
+  LiteralSearcher<wchar_t> searcher(L"abcab");
+  pair<StrConstIt<wchar_t>, StrConstIt<wchar_t>> match;
+  wstring s = L"xabcaxabcbabcabcab";
+
+  EXPECT_TRUE(searcher.Search(s.cbegin(), s.cend(), match));
+  EXPECT_EQ(match.first - s.cbegin(), 10);
+  EXPECT_FALSE(searcher.Search(s.cbegin() + 14, s.cend(), match));
+}
+
+TEST(LiteralSearcher, UTF8) {
+  // '目' and 'î' share the low byte 0xee, so they share a shift.
+  LiteralSearcher<wchar_t> searcher(L"目的");
+  pair<StrConstIt<wchar_t>, StrConstIt<wchar_t>> match;
+  wstring s = L"îî目目的";
+
+  EXPECT_TRUE(searcher.Search(s.cbegin(), s.cend(), match));
+  EXPECT_EQ(match.first - s.cbegin(), 3);
+}
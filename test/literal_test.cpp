@@ -0,0 +1,117 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#include "gtest/gtest.h"
+#include "literal.h"
+
+using namespace XyRegEngine;
+using namespace std;
+
+using Strings = set<string>;
+
+TEST(LiteralExtractor, Concatenation) {
+  EXPECT_EQ(LiteralExtractor<char>::ExtractPrefixes("GET /api/\\w+"),
+            Strings{"GET /api/"});
+  EXPECT_EQ(LiteralExtractor<char>::ExtractPrefixes("ERROR: (\\d+)"),
+            Strings{"ERROR: "});
+  EXPECT_EQ(LiteralExtractor<char>::ExtractPrefixes("\\bfoo\\.\\t"),
+            Strings{"foo.\t"});
+  EXPECT_EQ(LiteralExtractor<char>::ExtractPrefixes("(a)\\1"), Strings{"a"});
+}
+
+TEST(LiteralExtractor, PrefixSet) {
+  EXPECT_EQ(LiteralExtractor<char>::ExtractPrefixes("(?:foo|ba)r\\d"),
+            (Strings{"bar", "foor"}));
+  EXPECT_EQ(LiteralExtractor<char>::ExtractPrefixes("ab?c"),
+            (Strings{"abc", "ac"}));
+  EXPECT_EQ(LiteralExtractor<char>::ExtractPrefixes("[x-z]{2}1+"),
+            (Strings{"xx1", "xy1", "xz1", "yx1", "yy1", "yz1", "zx1", "zy1",
+                     "zz1"}));
+}
+
+TEST(LiteralExtractor, Truncation) {
+  // Too many combinations keep the shorter prefixes.
+  EXPECT_EQ(LiteralExtractor<char>::ExtractPrefixes("[a-d][e-h](?:i|j|k)"),
+            (Strings{"ae", "af", "ag", "ah", "be", "bf", "bg", "bh", "ce",
+                     "cf", "cg", "ch", "de", "df", "dg", "dh"}));
+  EXPECT_EQ(LiteralExtractor<char>::ExtractPrefixes(string(20, 'a')),
+            Strings{string(LiteralExtractor<char>::kMaxLiteralLength, 'a')});
+}
+
+TEST(LiteralExtractor, NoPrefix) {
+  EXPECT_TRUE(LiteralExtractor<char>::ExtractPrefixes("a*b").empty());
+  EXPECT_TRUE(LiteralExtractor<char>::ExtractPrefixes("\\w+@").empty());
+  EXPECT_TRUE(LiteralExtractor<char>::ExtractPrefixes("a|.").empty());
+  EXPECT_TRUE(LiteralExtractor<char>::ExtractPrefixes("[^a]").empty());
+  EXPECT_TRUE(LiteralExtractor<char>::ExtractPrefixes("a|").empty());
+}
+
+TEST(LiteralExtractor, Required) {
+  int max_offset;
+
+  EXPECT_EQ(LiteralExtractor<char>::ExtractRequired("\\w+@example\\.com",
+                                                    max_offset),
+            Strings{"@example.com"});
+  EXPECT_EQ(max_offset, INT_MAX);
+
+  // The longer literals after the group are chosen.
+  EXPECT_EQ(LiteralExtractor<char>::ExtractRequired("(a|b)\\d{2}(?:foo|bar)",
+                                                    max_offset),
+            (Strings{"bar", "foo"}));
+  EXPECT_EQ(max_offset, 3);
+
+  // Prefixes win a tie.
+  EXPECT_EQ(LiteralExtractor<char>::ExtractRequired("ab\\d+cd", max_offset),
+            Strings{"ab"});
+  EXPECT_EQ(max_offset, 0);
+
+  // Literals out of repetitions and rarer literals win a tie.
+  EXPECT_EQ(LiteralExtractor<char>::ExtractRequired("(a+)b\\1", max_offset),
+            Strings{"b"});
+  EXPECT_EQ(max_offset, INT_MAX);
+  EXPECT_EQ(LiteralExtractor<char>::ExtractRequired("e\\d+q", max_offset),
+            Strings{"q"});
+
+  // A literal cut inside a repetition occurs all over a run of it.
+  EXPECT_EQ(LiteralExtractor<char>::ExtractRequired("(?:ab){300}c",
+                                                    max_offset),
+            Strings{"c"});
+  EXPECT_EQ(max_offset, 600);
+
+  EXPECT_TRUE(LiteralExtractor<char>::ExtractRequired("\\w+|a", max_offset)
+                      .empty());
+}
+
+TEST(LiteralExtractor, String) {
+  string literal;
+
+  EXPECT_TRUE(LiteralExtractor<char>::ExtractString("user\\[id\\]", literal));
+  EXPECT_EQ(literal, "user[id]");
+  EXPECT_TRUE(LiteralExtractor<char>::ExtractString(string(20, 'a'), literal));
+  EXPECT_EQ(literal, string(20, 'a'));
+
+  EXPECT_FALSE(LiteralExtractor<char>::ExtractString("a.conf", literal));
+  EXPECT_FALSE(LiteralExtractor<char>::ExtractString("a|b", literal));
+  EXPECT_FALSE(LiteralExtractor<char>::ExtractString("(ab)", literal));
+  EXPECT_FALSE(LiteralExtractor<char>::ExtractString("\\bab", literal));
+  EXPECT_FALSE(LiteralExtractor<char>::ExtractString("", literal));
+}
+
+TEST(LiteralExtractor, Exact) {
+  EXPECT_EQ(LiteralExtractor<char>::ExtractExact("error|fatal|panic"),
+            (Strings{"error", "fatal", "panic"}));
+  EXPECT_EQ(LiteralExtractor<char>::ExtractExact("\\.(?:com|net)s?"),
+            (Strings{".com", ".coms", ".net", ".nets"}));
+
+  // An alternation may hold far more literals than a concatenation.
+  string regex = "k0";
+  for (int i = 1; i < 1000; ++i) {
+    regex += "|k" + to_string(i);
+  }
+  EXPECT_EQ(LiteralExtractor<char>::ExtractExact(regex).size(), 1000);
+
+  EXPECT_TRUE(LiteralExtractor<char>::ExtractExact("ab+").empty());
+  EXPECT_TRUE(LiteralExtractor<char>::ExtractExact("a|b?").empty());
+  EXPECT_TRUE(LiteralExtractor<char>::ExtractExact(string(20, 'a')).empty());
+}
@@ -5,6 +5,8 @@
 #include "gtest/gtest.h"
 #include "nfa.h"
 
+#include <thread>
+
 using namespace XyRegEngine;
 using namespace std;
 
@@ -12,6 +14,12 @@ TEST(Nfa, InvalidRegex) {
   Nfa<char> nfa("a|");
 
   EXPECT_TRUE(nfa.Empty());
+
+  for (auto regex:{"", "a||b", "*a", "(|a)", "()", "a)", "(a", "(?x)",
+                    "a{2", "a{,3}", "a{3,2}", "a{x}", "a{99999999999}",
+                    "a\\"}) {
+    EXPECT_TRUE(Nfa<char>(regex).Empty()) << regex;
+  }
 }
 
 TEST(Nfa, Alternative) {
@@ -144,6 +152,94 @@ TEST(Nfa, Quantifier_mTon) {
   EXPECT_EQ(nfa.NextMatch(begin, end), nullptr);
 }
 
+TEST(Nfa, Quantifier_NonGreedy) {
+  // The longest match is always returned.
+  Nfa<char> nfa("a+?b*?c??a{1,2}?");
+  string s = "aabbcaa";
+  auto begin = s.cbegin(), end = s.cend();
+
+  auto match_end = nfa.NextMatch(begin, end)->first.second;
+  EXPECT_EQ(string(begin, match_end), "aabbcaa");
+}
+
+TEST(Nfa, Quantifier_Large) {
+  Nfa<char> nfa("x\\d{2,1000}y");
+  string s = "x" + string(999, '1') + "y";
+
+  auto match_end = nfa.NextMatch(s.cbegin(), s.cend())->first.second;
+  EXPECT_EQ(match_end, s.cend());
+
+  s = "x1y";
+  EXPECT_EQ(nfa.NextMatch(s.cbegin(), s.cend()), nullptr);
+
+  s = "x" + string(1001, '1') + "y";
+  EXPECT_EQ(nfa.NextMatch(s.cbegin(), s.cend()), nullptr);
+
+  Nfa<char> unbounded("(?:ab){300,}");
+  s.clear();
+  for (int i = 0; i < 301; ++i) {
+    s += "ab";
+  }
+  match_end = unbounded.NextMatch(s.cbegin(), s.cend())->first.second;
+  EXPECT_EQ(match_end, s.cend());
+  EXPECT_EQ(unbounded.NextMatch(s.cbegin() + 4, s.cend()), nullptr);
+}
+
+TEST(Nfa, Quantifier_LargeGroup) {
+  Nfa<char> nfa("(?:(a)|(b)){0,500}(c)");
+  string s = string(300, 'a') + "bac";
+  auto state = nfa.NextMatch(s.cbegin(), s.cend());
+
+  ASSERT_NE(state, nullptr);
+  EXPECT_EQ(state->first.second, s.cend());
+  ASSERT_EQ(state->second.size(), 3);
+  // a group keeps the last repetition matching it
+  EXPECT_EQ(state->second[0].first - s.cbegin(), 301);
+  EXPECT_EQ(string(state->second[0].first, state->second[0].second), "a");
+  EXPECT_EQ(state->second[1].first - s.cbegin(), 300);
+  EXPECT_EQ(string(state->second[2].first, state->second[2].second), "c");
+
+  StrConstIt<char> match_begin;
+  s = "xxc";
+  state = nfa.Search(s.cbegin(), s.cend(), match_begin);
+  ASSERT_NE(state, nullptr);
+  EXPECT_EQ(match_begin - s.cbegin(), 2);
+  EXPECT_EQ(state->second[0].first, s.cend());
+}
+
+TEST(Nfa, Quantifier_LargeCounter) {
+  // assertions and back-references are checked in every repetition
+  Nfa<char> nfa("(a) (?:\\b\\1b\\b ){300}");
+  string s = "a ";
+  for (int i = 0; i < 300; ++i) {
+    s += "ab ";
+  }
+  auto state = nfa.NextMatch(s.cbegin(), s.cend());
+  ASSERT_NE(state, nullptr);
+  EXPECT_EQ(state->first.second, s.cend());
+  s.back() = 'x';
+  EXPECT_EQ(nfa.NextMatch(s.cbegin(), s.cend()), nullptr);
+
+  // x may be empty
+  Nfa<char> empty("(?:a?){600}b");
+  s = "aab";
+  state = empty.NextMatch(s.cbegin(), s.cend());
+  ASSERT_NE(state, nullptr);
+  EXPECT_EQ(state->first.second, s.cend());
+
+  Nfa<char> nested("(?:(?:ab){300}c){2,}");
+  s.clear();
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 300; ++j) {
+      s += "ab";
+    }
+    s += "c";
+  }
+  state = nested.NextMatch(s.cbegin(), s.cend());
+  ASSERT_NE(state, nullptr);
+  EXPECT_EQ(state->first.second, s.cend());
+}
+
 TEST(Nfa, Assertion_PositiveLookahead) {
   Nfa<char> nfa("(?=a)ab");
   string s = "ab";
@@ -168,6 +264,17 @@ TEST(Nfa, Assertion_NegativeLookahead) {
   EXPECT_EQ(nfa.NextMatch(begin, end), nullptr);
 }
 
+TEST(Nfa, Assertion_LookaheadGroup) {
+  // Groups in a lookahead don't count in the regex.
+  Nfa<char> nfa("(?=(a)b)(a)b");
+  string s = "ab";
+  auto state = nfa.NextMatch(s.cbegin(), s.cend());
+
+  EXPECT_EQ(nfa.GetGroupNum(), 1);
+  ASSERT_NE(state, nullptr);
+  EXPECT_EQ(string(state->second[0].first, state->second[0].second), "a");
+}
+
 TEST(Nfa, ContinuousAssertion) {
   Nfa<char> nfa("(?!ad)(?=ab)ab");
   string s = "abab";
@@ -244,6 +351,117 @@ TEST(Nfa, Group) {
   EXPECT_EQ(nfa.NextMatch(begin, end), nullptr);
 }
 
+TEST(Nfa, GroupMatchesOnce) {
+  Nfa<char> nfa("(aa)");
+  string s = "aaaa";
+  auto begin = s.cbegin(), end = s.cend();
+
+  auto match_end = nfa.NextMatch(begin, end)->first.second;
+  EXPECT_EQ(string(begin, match_end), "aa");
+}
+
+TEST(Nfa, QuantifiedEmptyGroup) {
+  Nfa<char> nfa("(a*)*b");
+  string s = "aab";
+  auto begin = s.cbegin(), end = s.cend();
+
+  auto match_end = nfa.NextMatch(begin, end)->first.second;
+  EXPECT_EQ(string(begin, match_end), "aab");
+
+  s = "aac";
+  EXPECT_EQ(nfa.NextMatch(s.cbegin(), s.cend()), nullptr);
+}
+
+TEST(Nfa, SubMatchSlots) {
+  Nfa<char> nfa("(a)*(b(c))(d)?");
+  string s = "aabc";
+  auto state = nfa.NextMatch(s.cbegin(), s.cend());
+
+  EXPECT_EQ(nfa.GetGroupNum(), 4);
+  ASSERT_EQ(state->second.size(), 4);
+  // only the last iteration is kept
+  EXPECT_EQ(state->second[0].first - s.cbegin(), 1);
+  EXPECT_EQ(string(state->second[0].first, state->second[0].second), "a");
+  EXPECT_EQ(string(state->second[1].first, state->second[1].second), "bc");
+  EXPECT_EQ(string(state->second[2].first, state->second[2].second), "c");
+  // an unmatched group is [end, end)
+  EXPECT_EQ(state->second[3].first, s.cend());
+  EXPECT_EQ(state->second[3].second, s.cend());
+}
+
+TEST(Nfa, QuantifiedNestedGroup) {
+  // A nested group is reset in every repetition.
+  Nfa<char> nfa("((a)|b)*");
+  string s = "ab";
+  auto state = nfa.NextMatch(s.cbegin(), s.cend());
+
+  ASSERT_NE(state, nullptr);
+  EXPECT_EQ(string(state->second[0].first, state->second[0].second), "b");
+  EXPECT_EQ(state->second[1].first, s.cend());
+  EXPECT_EQ(state->second[1].second, s.cend());
+}
+
+TEST(Nfa, TiedSubMatch) {
+  // The left alternative and longer repetitions are tried first.
+  Nfa<char> nfa("(a|ab)(b?)(b*)");
+  string s = "abb";
+  auto state = nfa.NextMatch(s.cbegin(), s.cend());
+
+  ASSERT_NE(state, nullptr);
+  EXPECT_EQ(string(state->second[0].first, state->second[0].second), "a");
+  EXPECT_EQ(string(state->second[1].first, state->second[1].second), "b");
+  EXPECT_EQ(string(state->second[2].first, state->second[2].second), "b");
+}
+
+TEST(Nfa, LongInput) {
+  Nfa<char> nfa("(?:a|b)*c");
+  string s(100000, 'a');
+  s.push_back('c');
+
+  auto match_end = nfa.NextMatch(s.cbegin(), s.cend())->first.second;
+  EXPECT_EQ(match_end, s.cend());
+}
+
+TEST(Nfa, LongInput_BackReference) {
+  // A match of the regex without its back-reference may only begin after
+  // the space, so threads keeping sub-matches only run from there.
+  Nfa<char> nfa("(\\w+)@\\1");
+  string s(50000, 'a');
+  StrConstIt<char> match_begin;
+
+  EXPECT_EQ(nfa.Search(s.cbegin(), s.cend(), match_begin), nullptr);
+
+  s += " ab@ab";
+  auto state = nfa.Search(s.cbegin(), s.cend(), match_begin);
+  ASSERT_NE(state, nullptr);
+  EXPECT_EQ(match_begin - s.cbegin(), 50001);
+  EXPECT_EQ(state->first.second, s.cend());
+}
+
+TEST(Nfa, BackReference_FailedCandidates) {
+  // Every word before the last pair may begin a match until its
+  // back-reference is checked.
+  Nfa<char> nfa("(\\w+)@\\1");
+  string s;
+  for (int i = 0; i < 20000; ++i) {
+    s += "ab@ac ";
+  }
+  s += "abc@ab abc@abc";
+  StrConstIt<char> match_begin;
+
+  auto state = nfa.Search(s.cbegin(), s.cend(), match_begin);
+  ASSERT_NE(state, nullptr);
+  EXPECT_EQ(s.cend() - match_begin, 7);
+  EXPECT_EQ(state->first.second, s.cend());
+  EXPECT_EQ(string(state->second[0].first, state->second[0].second), "abc");
+
+  s = "a@b ab@ab";
+  state = nfa.Search(s.cbegin(), s.cend(), match_begin);
+  ASSERT_NE(state, nullptr);
+  EXPECT_EQ(match_begin - s.cbegin(), 4);
+  EXPECT_EQ(state->first.second, s.cend());
+}
+
 TEST(Nfa, PassiveGroup) {
   Nfa<char> nfa("(?:abc)a");
   string s = "abca";
@@ -268,6 +486,14 @@ TEST(Nfa, NestedGroup) {
   EXPECT_EQ(nfa.NextMatch(begin, end), nullptr);
 }
 
+TEST(Nfa, AssertionInGroup) {
+  // Assertions in a group see the whole string.
+  string s = "ab";
+  EXPECT_EQ(Nfa<char>("a(^b)").NextMatch(s.cbegin(), s.cend()), nullptr);
+  EXPECT_EQ(Nfa<char>("a(\\bb)").NextMatch(s.cbegin(), s.cend()), nullptr);
+  EXPECT_NE(Nfa<char>("a(\\Bb)").NextMatch(s.cbegin(), s.cend()), nullptr);
+}
+
 TEST(Nfa, BackReference) {
   Nfa<char> nfa("(a*)bc\\1");
   string s = "aabcaaa";
@@ -280,6 +506,26 @@ TEST(Nfa, BackReference) {
   EXPECT_EQ(nfa.NextMatch(begin, end), nullptr);
 }
 
+TEST(Nfa, NestedGroupBackReference) {
+  Nfa<char> nfa("(a(b))c\\2");
+  string s = "abcb";
+  auto begin = s.cbegin(), end = s.cend();
+
+  auto match_end = nfa.NextMatch(begin, end)->first.second;
+  EXPECT_EQ(string(begin, match_end), "abcb");
+}
+
+TEST(Nfa, BackReferenceInGroup) {
+  Nfa<char> nfa("((a)\\2)b");
+  string s = "aab";
+  auto state = nfa.NextMatch(s.cbegin(), s.cend());
+
+  ASSERT_NE(state, nullptr);
+  EXPECT_EQ(string(s.cbegin(), state->first.second), "aab");
+  EXPECT_EQ(string(state->second[0].first, state->second[0].second), "aa");
+  EXPECT_EQ(string(state->second[1].first, state->second[1].second), "a");
+}
+
 TEST(Nfa, SeveralBackReference) {
   Nfa<char> nfa(R"((a*)(b*)c\1\1\2)");
   string s = "aabcaaaab";
@@ -344,6 +590,22 @@ TEST(Nfa, ExceptRange) {
   EXPECT_EQ(nfa.NextMatch(begin, end), nullptr);
 }
 
+TEST(Nfa, RangeCharacters) {
+  // Single characters, overlapping ranges and a trailing -
+  Nfa<char> nfa("[ac][aa-c][a-]");
+  string s = "aba-";
+  auto begin = s.cbegin(), end = s.cend();
+
+  auto match_end = nfa.NextMatch(begin, end)->first.second;
+  EXPECT_EQ(string(begin, match_end), "aba");
+
+  s = "bba";
+  EXPECT_EQ(nfa.NextMatch(s.cbegin(), s.cend()), nullptr);
+
+  s = "cab";
+  EXPECT_EQ(nfa.NextMatch(s.cbegin(), s.cend()), nullptr);
+}
+
 TEST(Nfa, UTF8) {
   Nfa<wchar_t> nfa(L"的");
   wstring s = L"的";
@@ -354,4 +616,80 @@ TEST(Nfa, UTF8) {
 
   begin = match_end;
   EXPECT_EQ(nfa.NextMatch(begin, end), nullptr);
-}
\ No newline at end of file
+}
+
+TEST(Nfa, CharLocation) {
+  // Bytes out of ASCII have no edges, and wide characters out of the
+  // table are found by a binary search.
+  Nfa<char> nfa("x+");
+  string s = "\xffxx\x80";
+  StrConstIt<char> match_begin;
+
+  auto state = nfa.Search(s.cbegin(), s.cend(), match_begin);
+  ASSERT_NE(state, nullptr);
+  EXPECT_EQ(string(match_begin, state->first.second), "xx");
+
+  Nfa<wchar_t> wide_nfa(L"的+a");
+  wstring ws = L"a\u00ff的的a";
+  StrConstIt<wchar_t> wide_match_begin;
+
+  auto wide_state = wide_nfa.Search(ws.cbegin(), ws.cend(), wide_match_begin);
+  ASSERT_NE(wide_state, nullptr);
+  EXPECT_EQ(wstring(wide_match_begin, wide_state->first.second), L"的的a");
+}
+
+TEST(Nfa, Search) {
+  Nfa<char> nfa("\\bab+|b+c");
+  string s = "cab abbbc";
+  StrConstIt<char> match_begin;
+
+  // "abbbc" is not matched as a whole since "bc" begins later than "abbb".
+  auto state = nfa.Search(s.cbegin() + 2, s.cend(), match_begin);
+  ASSERT_NE(state, nullptr);
+  EXPECT_EQ(string(match_begin, state->first.second), "abbb");
+
+  s = "cab";
+  EXPECT_EQ(nfa.Search(s.cbegin() + 2, s.cend(), match_begin), nullptr);
+}
+
+TEST(Nfa, SearchWithGroup) {
+  Nfa<char> nfa("(a+)b\\1");
+  string s = "aaaabaa";
+  StrConstIt<char> match_begin;
+
+  auto state = nfa.Search(s.cbegin(), s.cend(), match_begin);
+  ASSERT_NE(state, nullptr);
+  EXPECT_EQ(string(match_begin, state->first.second), "aabaa");
+  EXPECT_EQ(string(state->second[0].first, state->second[0].second), "aa");
+
+  // without back-references, groups are searched in a single run
+  nfa = Nfa<char>("(a+)(b+)");
+  s = "cabbab";
+  state = nfa.Search(s.cbegin(), s.cend(), match_begin);
+  ASSERT_NE(state, nullptr);
+  EXPECT_EQ(match_begin - s.cbegin(), 1);
+  EXPECT_EQ(string(state->second[0].first, state->second[0].second), "a");
+  EXPECT_EQ(string(state->second[1].first, state->second[1].second), "bb");
+}
+
+TEST(Nfa, ParallelCompile) {
+  // Every compilation numbers its states by itself, so NFAs can be built in
+  // several threads at once.
+  vector<int> results(8);
+  vector<thread> threads;
+  for (int i = 0; i < static_cast<int>(results.size()); ++i) {
+    threads.emplace_back([&results, i] {
+      for (int j = 0; j < 50; ++j) {
+        Nfa<char> nfa("(a|b)*c(\\d{2})");
+        string s = "xabc12";
+        auto state = nfa.NextMatch(s.cbegin() + 1, s.cend());
+        results[i] += state != nullptr && state->first.second == s.cend();
+      }
+    });
+  }
+  for (auto &t:threads) {
+    t.join();
+  }
+
+  EXPECT_EQ(results, vector<int>(8, 50));
+}
@@ -0,0 +1,82 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#include "gtest/gtest.h"
+#include "prefilter.h"
+
+using namespace XyRegEngine;
+using namespace std;
+
+TEST(Prefilter, SinglePrefix) {
+  Prefilter<char> prefilter({"foo"});
+  // candidates in every vector block and near the end
+  string s = string(40, 'f') + "fxo" + string(29, 'o') + "foo";
+
+  EXPECT_EQ(prefilter.FindLiteral(s.cbegin(), s.cend()) - s.cbegin(), 72);
+  EXPECT_EQ(prefilter.FindLiteral(s.cbegin(), s.cend() - 1), s.cend() - 1);
+}
+
+TEST(Prefilter, SeveralPrefixes) {
+  Prefilter<char> prefilter({"ab", "abc", "ca", "de", "e"});
+  string s = "xxxxxacxxxxxxxxxxxxdxca";
+
+  EXPECT_EQ(prefilter.FindLiteral(s.cbegin(), s.cend()) - s.cbegin(), 21);
+  s[20] = 'd';
+  s[21] = 'e';
+  EXPECT_EQ(prefilter.FindLiteral(s.cbegin(), s.cend()) - s.cbegin(), 20);
+  s = "abc";
+  EXPECT_EQ(prefilter.FindLiteral(s.cbegin() + 1, s.cend()), s.cend());
+}
+
+TEST(Prefilter, ManyLiterals) {
+  // Literals with many first characters are found by Teddy when it is
+  // available.
+  Prefilter<char> prefilter({"ERROR", "WARN", "INFO", "DEBUG", "TRACE",
+                             "FATAL", "EMERG"});
+  string s = string(50, 'x') + "DEBU" + string(20, 'x') + "INFO";
+
+  EXPECT_EQ(prefilter.FindLiteral(s.cbegin(), s.cend()) - s.cbegin(), 74);
+  s.replace(60, 5, "ERROR");
+  EXPECT_EQ(prefilter.FindLiteral(s.cbegin(), s.cend()) - s.cbegin(), 60);
+}
+
+TEST(Prefilter, Keywords) {
+  // Too many literals for Teddy are verified by an Aho-Corasick automaton.
+  set<string> literals;
+  for (int i = 0; i < 100; ++i) {
+    literals.insert("key" + to_string(i) + ";");
+  }
+  Prefilter<char> prefilter(literals);
+  string s = string(50, 'x') + "key100;key7;key42;";
+
+  EXPECT_EQ(prefilter.FindLiteral(s.cbegin(), s.cend()) - s.cbegin(), 57);
+  EXPECT_EQ(prefilter.FindLiteral(s.cbegin(), s.cend() - 1) - s.cbegin(), 57);
+  EXPECT_EQ(prefilter.FindLiteral(s.cbegin() + 58, s.cend() - 1),
+            s.cend() - 1);
+}
+
+TEST(Prefilter, Window) {
+  Prefilter<char> prefilter({"ab"}, 3);
+  string s = "xxxxxxabxxab";
+  auto begin = s.cbegin();
+
+  auto candidates = prefilter.Find(begin, s.cend());
+  EXPECT_EQ(candidates.first - begin, 3);
+  EXPECT_EQ(candidates.second - begin, 7);
+
+  candidates = prefilter.Find(begin + 9, s.cend());
+  EXPECT_EQ(candidates.first - begin, 9);
+  EXPECT_EQ(candidates.second - begin, 11);
+
+  candidates = prefilter.Find(begin + 11, s.cend());
+  EXPECT_EQ(candidates.first, s.cend());
+}
+
+TEST(Prefilter, UTF8) {
+  Prefilter<wchar_t> prefilter({L"的", L"目的"});
+  wstring s = L"目目的";
+
+  EXPECT_EQ(prefilter.FindLiteral(s.cbegin(), s.cend()) - s.cbegin(), 1);
+  EXPECT_EQ(prefilter.FindLiteral(s.cbegin() + 2, s.cend()) - s.cbegin(), 2);
+}
@@ -0,0 +1,71 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#include "gtest/gtest.h"
+#include "regex_set.h"
+
+using namespace XyRegEngine;
+using namespace std;
+
+TEST(RegexSet, Search) {
+  RegexSet<char> regex_set({"error", "\\d+ms", "time(out)?", "warn|fatal"});
+
+  EXPECT_EQ(regex_set.Size(), 4);
+  EXPECT_EQ(regex_set.Search("error: timeout after 30ms"),
+            (vector<bool>{true, true, true, false}));
+  EXPECT_EQ(regex_set.Search("fatal"),
+            (vector<bool>{false, false, false, true}));
+  EXPECT_EQ(regex_set.Search(""), (vector<bool>(4)));
+}
+
+TEST(RegexSet, Match) {
+  RegexSet<char> regex_set({"a+", "[a-c]*", "ab", "(a|b)c"});
+
+  EXPECT_EQ(regex_set.Match("aa"), (vector<bool>{true, true, false, false}));
+  EXPECT_EQ(regex_set.Match("bc"), (vector<bool>{false, true, false, true}));
+  EXPECT_EQ(regex_set.Match(""), (vector<bool>{false, true, false, false}));
+  EXPECT_EQ(regex_set.Match("abd"), (vector<bool>(4)));
+}
+
+TEST(RegexSet, Fallback) {
+  // Assertions and back-references are matched by their own regexes and
+  // invalid regexes never match.
+  RegexSet<char> regex_set({"^ab", "(a)\\1", "a|", "b"});
+  string s = "aab";
+
+  EXPECT_EQ(regex_set.Search(s), (vector<bool>{true, true, false, true}));
+  EXPECT_EQ(regex_set.Match("aa"), (vector<bool>{false, true, false, false}));
+}
+
+TEST(RegexSet, ManyRegexes) {
+  vector<string> regexes;
+  for (int i = 0; i < 500; ++i) {
+    regexes.push_back("id" + to_string(i) + "=\\d+");
+  }
+  RegexSet<char> regex_set(regexes);
+
+  auto matched = regex_set.Search("id7=1 id42=x id499=0 id42=3");
+  EXPECT_EQ(count(matched.cbegin(), matched.cend(), true), 3);
+  EXPECT_TRUE(matched[7]);
+  EXPECT_TRUE(matched[42]);
+  EXPECT_TRUE(matched[499]);
+}
+
+TEST(RegexSet, ClearCache) {
+  // The cache only holds the dead state, the start state and one more
+  // state, so it is cleared at almost every character.
+  RegexSet<char> regex_set({"abc", "bcd", "x"}, 3);
+
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_EQ(regex_set.Search("zabcdz"), (vector<bool>{true, true, false}));
+    EXPECT_EQ(regex_set.Match("bcd"), (vector<bool>{false, true, false}));
+  }
+}
+
+TEST(RegexSet, UTF8) {
+  RegexSet<wchar_t> regex_set({L"[的-目]\\w", L"目+"});
+
+  EXPECT_EQ(regex_set.Search(L"x的0"), (vector<bool>{true, false}));
+  EXPECT_EQ(regex_set.Match(L"目目"), (vector<bool>{false, true}));
+}
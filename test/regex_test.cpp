@@ -5,7 +5,9 @@
 #include "gtest/gtest.h"
 #include "xy_regex.h"
 
+#include <atomic>
 #include <codecvt>
+#include <thread>
 
 using namespace XyRegEngine;
 using namespace std;
@@ -52,6 +54,233 @@ TEST(Regex, SearchFailure) {
   EXPECT_TRUE(result.GetSubMatches().empty());
 }
 
+TEST(Regex, SearchLongInput) {
+  Regex<char> regex("\\bab\\d+");
+  RegexResult<char> result;
+  string s(100000, 'a');
+
+  EXPECT_FALSE(regex.Search(s, result));
+
+  s += " ab12";
+  EXPECT_TRUE(regex.Search(s, result));
+
+  auto sub_match = result.GetResult();
+  EXPECT_EQ(string(sub_match.first, sub_match.second), "ab12");
+}
+
+TEST(Regex, SearchLongRepetition) {
+  // The literal after the repetition rules out most of the string.
+  Regex<char> regex("(?:ab){300}c");
+  RegexResult<char> result;
+  string s;
+  for (int i = 0; i < 10000; ++i) {
+    s += "ab";
+  }
+
+  EXPECT_FALSE(regex.Search(s, result));
+
+  s += "c";
+  EXPECT_TRUE(regex.Search(s, result));
+  auto sub_match = result.GetResult();
+  EXPECT_EQ(sub_match.first - s.cbegin(), 19400);
+  EXPECT_EQ(sub_match.second, s.cend());
+}
+
+TEST(Regex, SearchWithPrefix) {
+  // The prefix "ab" appears several times before the match.
+  Regex<char> regex("ab(c|d)\\1");
+  RegexResult<char> result;
+  string s = string(100, 'a') + "abcd abd abdd";
+
+  EXPECT_TRUE(regex.Search(s, result));
+  auto sub_match = result.GetResult();
+  EXPECT_EQ(sub_match.first - s.cbegin(), 109);
+  EXPECT_EQ(string(sub_match.first, sub_match.second), "abdd");
+
+  s = string(100, 'a') + "ab";
+  EXPECT_FALSE(regex.Search(s, result));
+}
+
+TEST(Regex, SearchWithInnerLiteral) {
+  Regex<char> regex("\\w+@example\\.com");
+  RegexResult<char> result;
+  string s = string(100, 'a') + " dxy@example.org dxy@example.com";
+
+  EXPECT_TRUE(regex.Search(s, result));
+  auto sub_match = result.GetResult();
+  EXPECT_EQ(string(sub_match.first, sub_match.second), "dxy@example.com");
+}
+
+TEST(Regex, PlainString) {
+  Regex<char> regex("nginx\\.conf");
+  RegexResult<char> result;
+
+  string s = "/etc/nginx/nginx.conf.d";
+
+  EXPECT_TRUE(regex.Search(s, result));
+  auto sub_match = result.GetResult();
+  EXPECT_EQ(string(sub_match.first, sub_match.second), "nginx.conf");
+
+  EXPECT_FALSE(regex.Search("nginx-conf", result));
+  EXPECT_TRUE(regex.Match("nginx.conf", result));
+  EXPECT_FALSE(regex.Match("nginx.confd", result));
+  EXPECT_FALSE(regex.CompileDfa());
+}
+
+TEST(Regex, Keywords) {
+  string keywords = "if";
+  for (int i = 0; i < 100; ++i) {
+    keywords += "|kw" + to_string(i);
+  }
+  Regex<char> regex(keywords);
+  RegexResult<char> result;
+
+  string s = "xx kw42 kw7";
+
+  EXPECT_TRUE(regex.Search(s, result));
+  auto sub_match = result.GetResult();
+  EXPECT_EQ(string(sub_match.first, sub_match.second), "kw42");
+
+  EXPECT_TRUE(regex.Match("kw99", result));
+  EXPECT_FALSE(regex.Match("kw100", result));
+  EXPECT_FALSE(regex.Search("kw", result));
+
+  // The keywords are also the prefilter of a larger regex.
+  Regex<char> call_regex("(?:" + keywords + ")\\(\\d+\\)");
+  s = "kw1 kw2() if(3)";
+  EXPECT_TRUE(call_regex.Search(s, result));
+  sub_match = result.GetResult();
+  EXPECT_EQ(string(sub_match.first, sub_match.second), "if(3)");
+}
+
+TEST(Regex, SearchAll) {
+  Regex<char> regex("(\\w+)=(\\d+)");
+  string s = "a=1, bc=22,d=x, e=333";
+  vector<string> matches;
+  vector<string> keys;
+
+  for (const auto &result:regex.SearchAll(s)) {
+    auto sub_match = result.GetResult();
+    matches.emplace_back(sub_match.first, sub_match.second);
+    // sub-matches of earlier matches are dropped
+    EXPECT_EQ(result.GetSubMatches().size(), 2);
+    sub_match = result.GetSubMatches()[0];
+    keys.emplace_back(sub_match.first, sub_match.second);
+  }
+  EXPECT_EQ(matches, (vector<string>{"a=1", "bc=22", "e=333"}));
+  EXPECT_EQ(keys, (vector<string>{"a", "bc", "e"}));
+}
+
+TEST(Regex, SearchAllEmptyMatch) {
+  Regex<char> regex("a*");
+  string s = "baac";
+  vector<pair<long, long>> matches;
+
+  for (auto it = regex.SearchAll(s).begin(); it != RegexIterator<char>();
+       ++it) {
+    auto sub_match = it->GetResult();
+    matches.emplace_back(sub_match.first - s.cbegin(),
+                         sub_match.second - s.cbegin());
+  }
+  // A match never begins at the end of the string.
+  EXPECT_EQ(matches, (vector<pair<long, long>>{{0, 0}, {1, 3}, {3, 3}}));
+
+  s = "";
+  auto range = regex.SearchAll(s);
+  EXPECT_EQ(range.begin(), range.end());
+}
+
+TEST(Regex, Scratch) {
+  // A scratch is shared by regexes of different sizes and results are
+  // reused.
+  Regex<char> date("(\\d+)-(\\d+)"), word("^(\\w)(\\w*)$");
+  MatchScratch<char> scratch;
+  RegexResult<char> result;
+
+  for (int i = 0; i < 3; ++i) {
+    string s = "on 2026-10 at 9-" + to_string(i);
+    EXPECT_TRUE(date.Search(s, result, scratch));
+    ASSERT_EQ(result.GetSubMatches().size(), 2);
+    auto sub_match = result.GetSubMatches()[0];
+    EXPECT_EQ(string(sub_match.first, sub_match.second), "2026");
+
+    s = "word" + to_string(i);
+    EXPECT_TRUE(word.Match(s, result, scratch));
+    ASSERT_EQ(result.GetSubMatches().size(), 2);
+    sub_match = result.GetSubMatches()[1];
+    EXPECT_EQ(string(sub_match.first, sub_match.second), "ord" + to_string(i));
+  }
+
+  string s = "x";
+  EXPECT_FALSE(date.Search(s, result, scratch));
+  EXPECT_TRUE(result.GetSubMatches().empty());
+}
+
+TEST(Regex, Copy) {
+  // Every engine is copied with the regex.
+  vector<Regex<char>> regexes{Regex<char>("abc"), Regex<char>("(a+)b"),
+                              Regex<char>("[a-c]+\\d"),
+                              Regex<char>("foo|bar|baz")};
+  auto dfa = regexes[2];
+  EXPECT_TRUE(dfa.CompileDfa());
+  regexes.push_back(dfa);
+  auto copies = regexes;
+  regexes.clear();
+
+  RegexResult<char> result;
+  string s = "xabc aab c1 bar";
+  vector<string> matches{"abc", "ab", "c1", "bar", "c1"};
+  for (int i = 0; i < static_cast<int>(copies.size()); ++i) {
+    EXPECT_TRUE(copies[i].Search(s, result));
+    auto sub_match = result.GetResult();
+    EXPECT_EQ(string(sub_match.first, sub_match.second), matches[i]);
+  }
+
+  Regex<char> group("(\\d)");
+  group = copies[1];
+  s = "aab";
+  EXPECT_TRUE(group.Match(s, result));
+  ASSERT_EQ(result.GetSubMatches().size(), 1);
+  auto sub_match = result.GetSubMatches()[0];
+  EXPECT_EQ(string(sub_match.first, sub_match.second), "aa");
+}
+
+TEST(Regex, SharedAcrossThreads) {
+  // A regex isn't written by matches with a scratch, so threads can share
+  // it, including its lazy DFA and lookaheads.
+  string s = "xy@xy ";
+  for (int i = 0; i < 200; ++i) {
+    s += "ab";
+  }
+  vector<Regex<char>> regexes{Regex<char>("(?:a|b)*a(?:a|b){80}"),
+                              Regex<char>("\\w+(?=@)"),
+                              Regex<char>("(\\w+)@\\1")};
+  for (const auto &regex:regexes) {
+    MatchScratch<char> expected_scratch;
+    RegexResult<char> expected;
+    ASSERT_TRUE(regex.Search(s, expected, expected_scratch));
+
+    vector<thread> threads;
+    atomic<int> failures{0};
+    for (int i = 0; i < 4; ++i) {
+      threads.emplace_back([&] {
+        MatchScratch<char> scratch;
+        RegexResult<char> result;
+        for (int j = 0; j < 50; ++j) {
+          if (!regex.Search(s, result, scratch) ||
+              result.GetResult() != expected.GetResult()) {
+            ++failures;
+          }
+        }
+      });
+    }
+    for (auto &thread:threads) {
+      thread.join();
+    }
+    EXPECT_EQ(failures, 0);
+  }
+}
+
 TEST(Regex, UTF8) {
   Regex<wchar_t> regex(L"(?:0|的)+");
   RegexResult<wchar_t> result;
@@ -67,4 +296,18 @@ TEST(Regex, UTF8) {
   sub_match = result.GetResult();
   s = wstring(sub_match.first, sub_match.second);
   EXPECT_EQ(s, L"0的");
-}
\ No newline at end of file
+}
+
+TEST(Regex, CompileDfa) {
+  Regex<char> regex("[a-c]+\\d");
+  RegexResult<char> result;
+
+  EXPECT_TRUE(regex.CompileDfa());
+  EXPECT_TRUE(regex.Search("ddab1", result));
+
+  auto sub_match = result.GetResult();
+  EXPECT_EQ(string(sub_match.first, sub_match.second), "ab1");
+
+  EXPECT_FALSE(Regex<char>("(a)").CompileDfa());
+  EXPECT_FALSE(Regex<char>("(?:a|b)*a(?:a|b){10}").CompileDfa(100));
+}
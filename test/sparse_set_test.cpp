@@ -0,0 +1,91 @@
+//
+// Created by dxy on 2026/10/16.
+//
+
+#include "gtest/gtest.h"
+#include "sparse_set.h"
+
+using namespace XyRegEngine;
+using namespace std;
+
+TEST(SparseSet, Insert) {
+  SparseSet sparse_set(10);
+
+  EXPECT_TRUE(sparse_set.Empty());
+  EXPECT_TRUE(sparse_set.Insert(7));
+  EXPECT_TRUE(sparse_set.Insert(2));
+  EXPECT_FALSE(sparse_set.Insert(7));
+  EXPECT_TRUE(sparse_set.Insert(0));
+
+  EXPECT_EQ(sparse_set.Size(), 3);
+  EXPECT_TRUE(sparse_set.Contains(2));
+  EXPECT_FALSE(sparse_set.Contains(3));
+  EXPECT_EQ(vector<int>(sparse_set.begin(), sparse_set.end()),
+            (vector<int>{7, 2, 0}));
+}
+
+TEST(SparseSet, Clear) {
+  SparseSet sparse_set(5);
+  for (int i = 0; i < 5; ++i) {
+    sparse_set.Insert(i);
+  }
+
+  sparse_set.Clear();
+  EXPECT_TRUE(sparse_set.Empty());
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_FALSE(sparse_set.Contains(i));
+  }
+
+  // stale indexes of removed elements are ignored
+  EXPECT_TRUE(sparse_set.Insert(4));
+  EXPECT_FALSE(sparse_set.Contains(0));
+  EXPECT_TRUE(sparse_set.Contains(4));
+  EXPECT_EQ(sparse_set.Capacity(), 5);
+
+  sparse_set.Resize(8);
+  EXPECT_TRUE(sparse_set.Empty());
+  EXPECT_TRUE(sparse_set.Insert(7));
+}
+
+TEST(TupleSet, Insert) {
+  TupleSet tuple_set(2);
+
+  EXPECT_TRUE(tuple_set.Empty());
+  EXPECT_TRUE(tuple_set.Insert(vector<int>{1, 2}));
+  EXPECT_TRUE(tuple_set.Insert(vector<int>{2, 1}));
+  EXPECT_FALSE(tuple_set.Insert(vector<int>{1, 2}));
+
+  EXPECT_EQ(tuple_set.Size(), 2);
+  EXPECT_TRUE(tuple_set.Contains(vector<int>{2, 1}));
+  EXPECT_FALSE(tuple_set.Contains(vector<int>{1, 1}));
+  EXPECT_EQ(tuple_set[1][0], 2);
+
+  // tuples are kept when the table grows
+  for (int i = 0; i < 100; ++i) {
+    tuple_set.Insert(vector<int>{i, -i});
+  }
+  EXPECT_EQ(tuple_set.Size(), 102);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(tuple_set.Contains(vector<int>{i, -i})) << i;
+  }
+  EXPECT_TRUE(tuple_set.Contains(vector<int>{1, 2}));
+}
+
+TEST(TupleSet, Clear) {
+  TupleSet tuple_set(1);
+  for (int i = 0; i < 20; ++i) {
+    tuple_set.Insert(vector<int>{i});
+  }
+
+  tuple_set.Clear();
+  EXPECT_TRUE(tuple_set.Empty());
+  for (int i = 0; i < 20; ++i) {
+    EXPECT_FALSE(tuple_set.Contains(vector<int>{i}));
+  }
+  EXPECT_TRUE(tuple_set.Insert(vector<int>{3}));
+
+  tuple_set.Reset(3);
+  EXPECT_TRUE(tuple_set.Empty());
+  EXPECT_EQ(tuple_set.Width(), 3);
+  EXPECT_TRUE(tuple_set.Insert(vector<int>{3, 0, 0}));
+}